@@ -33,6 +33,35 @@ LICENSE
 #define CDLOD_MAX_LODS 8
 #endif
 
+/* Fraction of a lod range after which nodes start morphing into the next lod */
+#ifndef CDLOD_MORPH_START_RATIO
+#define CDLOD_MORPH_START_RATIO 0.66f
+#endif
+
+/* Post-transform vertex cache size (FIFO entries) the grid patch index order
+ * is tuned for: grids are emitted in bands of CDLOD_VERTEX_CACHE_SIZE / 2 - 1
+ * quads so that a band row and the row below it stay in the cache
+ */
+#ifndef CDLOD_VERTEX_CACHE_SIZE
+#define CDLOD_VERTEX_CACHE_SIZE 16
+#endif
+
+/* Morph distance used for the coarsest lod which has nothing to morph into */
+#define CDLOD_MORPH_DISABLED 1.0e30f
+
+/* SIMD kernels are selected at compile time, define CDLOD_NO_SIMD to always use
+ * the scalar C89 code paths
+ */
+#ifndef CDLOD_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CDLOD_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CDLOD_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 #ifdef __GNUC__
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
@@ -46,7 +75,7 @@ CDLOD_API CDLOD_INLINE float cdlod_invsqrt(float number)
   union
   {
     float f;
-    long i;
+    int i; /* must match the 32 bit float (long is 64 bit on LP64 targets) */
   } conv;
 
   float x2, y;
@@ -71,292 +100,5480 @@ CDLOD_API CDLOD_INLINE float cdlod_sqrtf(float x)
   return (x * cdlod_invsqrt(x));
 }
 
+/* tan(x) for x in [0, pi / 2) from the sine and cosine series */
+CDLOD_API CDLOD_INLINE float cdlod_tanf(float x)
+{
+  float x2 = x * x;
+  float s = x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f * (1.0f - x2 / 110.0f)))));
+  float c = 1.0f - x2 / 2.0f * (1.0f - x2 / 12.0f * (1.0f - x2 / 30.0f * (1.0f - x2 / 56.0f * (1.0f - x2 / 90.0f * (1.0f - x2 / 132.0f)))));
+
+  return s / c;
+}
+
 typedef float (*cdlod_height_function)(float x, float z);
 
+/* height callback of large worlds: called with world positions in double
+ * precision (see cdlod_frame_init_world)
+ */
+typedef float (*cdlod_height_world_function)(double x, double z);
+
+/* batched height callback: out[i] = height(xs[i], zs[i]) for i < n */
+typedef void (*cdlod_height_batch_function)(const float *xs, const float *zs, float *out, int n);
+
+/* Maximum number of points passed to a cdlod_height_batch_function at once */
+#ifndef CDLOD_HEIGHT_BATCH_SIZE
+#define CDLOD_HEIGHT_BATCH_SIZE 64
+#endif
+
+/* heightmap stored in row major order (sample (x, z) at data[z * width + x]).
+ * world height = sample * height_scale + height_offset, positions outside of
+ * the map are clamped to the border.
+ */
+typedef struct cdlod_heightmap
+{
+  int width;                    /* samples per row (>= 2) */
+  int height;                   /* number of rows (>= 2) */
+  float origin_x, origin_z;     /* world position of sample (0, 0) */
+  float scale;                  /* world distance between two samples */
+  float height_scale;           /* world height per sample unit */
+  float height_offset;          /* world height of sample value 0 */
+  const unsigned short *data16; /* 16 bit samples, used when set */
+  const float *data32;          /* float samples otherwise */
+
+} cdlod_heightmap;
+
+/* map a world position to the lower left sample of its cell (index) and the
+ * bilinear weights inside of the cell
+ */
+CDLOD_API CDLOD_INLINE void cdlod_heightmap_cell(
+    cdlod_heightmap *map, float inv_scale, float x, float z,
+    int *index, float *tx, float *tz)
+{
+  float max_x = (float)(map->width - 1);
+  float max_z = (float)(map->height - 1);
+  float fx = (x - map->origin_x) * inv_scale;
+  float fz = (z - map->origin_z) * inv_scale;
+  int x0, z0;
+
+  fx = fx < 0.0f ? 0.0f : (fx > max_x ? max_x : fx);
+  fz = fz < 0.0f ? 0.0f : (fz > max_z ? max_z : fz);
+
+  /* truncation is floor here, the last row/column uses the last cell at t = 1 */
+  x0 = (int)fx;
+  z0 = (int)fz;
+  x0 -= (x0 == map->width - 1);
+  z0 -= (z0 == map->height - 1);
+
+  *index = z0 * map->width + x0;
+  *tx = fx - (float)x0;
+  *tz = fz - (float)z0;
+}
+
+/* bilinear sampling of n world positions */
+CDLOD_API CDLOD_INLINE void cdlod_heightmap_sample(
+    cdlod_heightmap *map,
+    const float *xs, const float *zs, float *out, int n)
+{
+  float inv_scale = 1.0f / map->scale;
+  float height_scale = map->height_scale;
+  float height_offset = map->height_offset;
+  int width = map->width;
+  int i;
+
+  /* separate loops per sample type keep the inner loop branch free */
+  if (map->data16)
+  {
+    const unsigned short *data = map->data16;
+
+    for (i = 0; i < n; ++i)
+    {
+      int index;
+      float tx, tz, h0, h1;
+
+      cdlod_heightmap_cell(map, inv_scale, xs[i], zs[i], &index, &tx, &tz);
+
+      h0 = (float)data[index] + ((float)data[index + 1] - (float)data[index]) * tx;
+      h1 = (float)data[index + width] + ((float)data[index + width + 1] - (float)data[index + width]) * tx;
+
+      out[i] = (h0 + (h1 - h0) * tz) * height_scale + height_offset;
+    }
+  }
+  else
+  {
+    const float *data = map->data32;
+
+    for (i = 0; i < n; ++i)
+    {
+      int index;
+      float tx, tz, h0, h1;
+
+      cdlod_heightmap_cell(map, inv_scale, xs[i], zs[i], &index, &tx, &tz);
+
+      h0 = data[index] + (data[index + 1] - data[index]) * tx;
+      h1 = data[index + width] + (data[index + width + 1] - data[index + width]) * tx;
+
+      out[i] = (h0 + (h1 - h0) * tz) * height_scale + height_offset;
+    }
+  }
+}
+
+/* where heights are sampled from */
+typedef struct cdlod_height_source
+{
+  cdlod_height_function function;    /* per point callback */
+  cdlod_height_batch_function batch; /* optional, preferred over function when set */
+  cdlod_heightmap *heightmap;        /* optional, sampled directly and preferred over both callbacks */
+
+  /* optional for large worlds, preferred over all of the above: positions are
+   * relative to the world position origin_x, origin_z and passed as
+   * origin + position in double precision
+   */
+  cdlod_height_world_function world;
+  double origin_x, origin_z;
+
+} cdlod_height_source;
+
+/* sample n heights (n <= CDLOD_HEIGHT_BATCH_SIZE keeps batches bounded) */
+CDLOD_API CDLOD_INLINE void cdlod_height_source_sample(
+    cdlod_height_source *source,
+    const float *xs, const float *zs, float *out, int n)
+{
+  int i;
+
+  if (source->world)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      out[i] = source->world(source->origin_x + (double)xs[i], source->origin_z + (double)zs[i]);
+    }
+    return;
+  }
+
+  if (source->heightmap)
+  {
+    cdlod_heightmap_sample(source->heightmap, xs, zs, out, n);
+    return;
+  }
+
+  if (source->batch)
+  {
+    source->batch(xs, zs, out, n);
+    return;
+  }
+
+  for (i = 0; i < n; ++i)
+  {
+    out[i] = source->function(xs[i], zs[i]);
+  }
+}
+
 /* quadtree node */
 typedef struct cdlod_quadtree_node
 {
   float x, z; /* center position */
   float size; /* patch size */
+  int lod;    /* lod level matching the node size (0 = highest detail) */
 
 } cdlod_quadtree_node;
 
-/* generate a single quad patch (two triangles) */
-CDLOD_API CDLOD_INLINE void cdlod_generate_patch(
+/* selected node descriptor
+ *
+ * compact per node output of cdlod_select() for instanced rendering: a single
+ * static grid mesh (e.g. cdlod_generate_grid_patch on a unit node with a flat
+ * height function) is drawn once per descriptor and scaled/offset by x, z, size.
+ */
+typedef struct cdlod_node
+{
+  float x, z;        /* center position */
+  float size;        /* patch size */
+  int lod;           /* lod level of the node (0 = highest detail) */
+  float morph_start; /* camera distance at which morphing towards lod + 1 starts */
+  float morph_end;   /* camera distance at which the node fully matches lod + 1 */
+  int seams;         /* 0 = skirts, otherwise stitched (see CDLOD_SEAMS_STITCHED) */
+
+} cdlod_node;
+
+/* cdlod_node.seams of stitched patches (CDLOD_SEAM_STITCH): CDLOD_SEAMS_STITCHED
+ * plus, per edge, the number of lods the neighbour across the edge is coarser
+ * (4 bits each, see cdlod_node_seam). stitched patches have no skirts.
+ */
+#define CDLOD_SEAMS_STITCHED 1
+
+#define CDLOD_EDGE_LEFT 0   /* x - size / 2 */
+#define CDLOD_EDGE_RIGHT 1  /* x + size / 2 */
+#define CDLOD_EDGE_BOTTOM 2 /* z - size / 2 */
+#define CDLOD_EDGE_TOP 3    /* z + size / 2 */
+
+/* lod difference to the coarser neighbour across an edge (0 = same or finer) */
+CDLOD_API CDLOD_INLINE int cdlod_node_seam(cdlod_node *node, int edge)
+{
+  return (node->seams >> (4 + edge * 4)) & 15;
+}
+
+/* how geomorphing is applied to generated grid patch vertices */
+typedef enum cdlod_morph_mode
+{
+  CDLOD_MORPH_NONE = 0,    /* xyz, no morphing */
+  CDLOD_MORPH_FACTOR = 1,  /* xyz + morph factor (4 floats per vertex), morph on the gpu */
+  CDLOD_MORPH_POSITION = 2 /* xyz already morphed on the cpu */
+
+} cdlod_morph_mode;
+
+/* status flags reported in cdlod_result */
+#define CDLOD_STATUS_OK 0
+#define CDLOD_STATUS_VERTICES_FULL 1 /* vertices_capacity too small, patches were dropped */
+#define CDLOD_STATUS_INDICES_FULL 2  /* indices_capacity too small, patches were dropped */
+#define CDLOD_STATUS_NODES_FULL 4    /* nodes_capacity too small, nodes were dropped */
+#define CDLOD_STATUS_STACK_FULL 8    /* traversal stack overflow, subtrees were dropped */
+#define CDLOD_STATUS_BUDGET 16       /* budget reached, nodes were selected coarser than their lod */
+#define CDLOD_STATUS_INVALID 32      /* unsupported frame settings, nothing was written */
+#define CDLOD_STATUS_OVER_BUDGET 64  /* the visible roots alone exceed the budget */
+
+/* outcome of a selection pass
+ *
+ * the required sizes are always computed for the complete frame, even when the
+ * outputs are too small or not requested at all (count only pass).
+ */
+typedef struct cdlod_result
+{
+  int status;             /* CDLOD_STATUS_OK or a combination of CDLOD_STATUS_* flags */
+  int vertices_required;  /* floats required to hold all selected patches */
+  int indices_required;   /* indices required to hold all selected patches */
+  int nodes_required;     /* number of selected nodes */
+
+} cdlod_result;
+
+/* output sub range of the patches of one lod (see cdlod_frame.lod_output) */
+typedef struct cdlod_lod_range
+{
+  int vertices_offset, vertices_count; /* floats */
+  int indices_offset, indices_count;
+  int nodes_offset, nodes_count;
+
+} cdlod_lod_range;
+
+/* number of quad patches (12 vertices, 30 indices) out of count that still fit into the buffers */
+CDLOD_API CDLOD_INLINE int cdlod_patches_fit(
+    int vertices_capacity, int vertices_count,
+    int indices_capacity, int indices_count,
+    int count)
+{
+  int fit_vertices = (vertices_capacity - vertices_count) / 36;
+  int fit_indices = (indices_capacity - indices_count) / 30;
+
+  count = fit_vertices < count ? fit_vertices : count;
+  count = fit_indices < count ? fit_indices : count;
+
+  return count < 0 ? 0 : count;
+}
+
+/* quad patch indices relative to the first patch vertex (CCW winding):
+ * two triangles, then two per skirt edge (left, right, bottom, top)
+ */
+#define CDLOD_PATCH_INDICES \
+  {0, 2, 1, 0, 3, 2, 0, 4, 3, 3, 4, 5, 1, 2, 6, 2, 7, 6, 0, 1, 8, 1, 9, 8, 3, 10, 2, 2, 10, 11}
+
+/* scalar C89 kernel of cdlod_generate_patches_sampled() */
+CDLOD_API CDLOD_INLINE int cdlod_generate_patches_scalar(
     float *vertices, int vertices_capacity, int *vertices_count,
     int *indices, int indices_capacity, int *indices_count,
-    cdlod_quadtree_node *node, cdlod_height_function height, float skirt_depth)
+    cdlod_quadtree_node *nodes, float *heights, int count,
+    float skirt_depth)
 {
-  int base_vertex;
-  float half;
-  float x0, x1, z0, z1;
-  float h00, h10, h11, h01;
+  static const int pattern[30] = CDLOD_PATCH_INDICES;
+  float *v = vertices + *vertices_count;
+  int *idx = indices + *indices_count;
+  int base_vertex = *vertices_count / 3;
+  int fit = cdlod_patches_fit(vertices_capacity, *vertices_count, indices_capacity, *indices_count, count);
+  int i, j;
 
-  /* check capacity (4 verts + 4*2 skirt verts = 12 verts, each 3 floats = 36) */
-  if (*vertices_count + 36 > vertices_capacity || *indices_count + (6 + 4 * 6) > indices_capacity)
+  for (i = 0; i < fit; ++i)
   {
-    return;
+    float half = nodes[i].size * 0.5f;
+    float x0 = nodes[i].x - half;
+    float x1 = nodes[i].x + half;
+    float z0 = nodes[i].z - half;
+    float z1 = nodes[i].z + half;
+    float h00 = heights[0];
+    float h10 = heights[1];
+    float h11 = heights[2];
+    float h01 = heights[3];
+    float s00 = h00 - skirt_depth;
+    float s10 = h10 - skirt_depth;
+    float s11 = h11 - skirt_depth;
+    float s01 = h01 - skirt_depth;
+
+    /* corners */
+    v[0] = x0;
+    v[1] = h00;
+    v[2] = z0;
+    v[3] = x1;
+    v[4] = h10;
+    v[5] = z0;
+    v[6] = x1;
+    v[7] = h11;
+    v[8] = z1;
+    v[9] = x0;
+    v[10] = h01;
+    v[11] = z1;
+
+    /* skirts: left (v0 -> v3), right (v1 -> v2), bottom (v0 -> v1), top (v3 -> v2) */
+    v[12] = x0;
+    v[13] = s00;
+    v[14] = z0;
+    v[15] = x0;
+    v[16] = s01;
+    v[17] = z1;
+    v[18] = x1;
+    v[19] = s10;
+    v[20] = z0;
+    v[21] = x1;
+    v[22] = s11;
+    v[23] = z1;
+    v[24] = x0;
+    v[25] = s00;
+    v[26] = z0;
+    v[27] = x1;
+    v[28] = s10;
+    v[29] = z0;
+    v[30] = x0;
+    v[31] = s01;
+    v[32] = z1;
+    v[33] = x1;
+    v[34] = s11;
+    v[35] = z1;
+
+    for (j = 0; j < 30; ++j)
+    {
+      idx[j] = base_vertex + pattern[j];
+    }
+
+    v += 36;
+    idx += 30;
+    base_vertex += 12;
+    heights += 4;
   }
 
-  base_vertex = *vertices_count / 3;
-  half = node->size * 0.5f;
+  *vertices_count += fit * 36;
+  *indices_count += fit * 30;
 
-  x0 = node->x - half;
-  x1 = node->x + half;
-  z0 = node->z - half;
-  z1 = node->z + half;
-
-  /* Cache corner heights */
-  h00 = height(x0, z0);
-  h10 = height(x1, z0);
-  h11 = height(x1, z1);
-  h01 = height(x0, z1);
-
-  /* vertices */
-  vertices[(*vertices_count)++] = x0;
-  vertices[(*vertices_count)++] = h00;
-  vertices[(*vertices_count)++] = z0;
-  vertices[(*vertices_count)++] = x1;
-  vertices[(*vertices_count)++] = h10;
-  vertices[(*vertices_count)++] = z0;
-  vertices[(*vertices_count)++] = x1;
-  vertices[(*vertices_count)++] = h11;
-  vertices[(*vertices_count)++] = z1;
-  vertices[(*vertices_count)++] = x0;
-  vertices[(*vertices_count)++] = h01;
-  vertices[(*vertices_count)++] = z1;
-
-  /* indices (CCW winding) */
-  indices[(*indices_count)++] = base_vertex + 0;
-  indices[(*indices_count)++] = base_vertex + 2;
-  indices[(*indices_count)++] = base_vertex + 1;
-
-  indices[(*indices_count)++] = base_vertex + 0;
-  indices[(*indices_count)++] = base_vertex + 3;
-  indices[(*indices_count)++] = base_vertex + 2;
-
-  /* skirts: each edge = 2 new verts + 2 triangles */
-
-  /* left edge (v0 -> v3) */
-  vertices[(*vertices_count)++] = x0;
-  vertices[(*vertices_count)++] = h00 - skirt_depth;
-  vertices[(*vertices_count)++] = z0;
-
-  vertices[(*vertices_count)++] = x0;
-  vertices[(*vertices_count)++] = h01 - skirt_depth;
-  vertices[(*vertices_count)++] = z1;
-
-  indices[(*indices_count)++] = base_vertex + 0;
-  indices[(*indices_count)++] = base_vertex + 4;
-  indices[(*indices_count)++] = base_vertex + 3;
-
-  indices[(*indices_count)++] = base_vertex + 3;
-  indices[(*indices_count)++] = base_vertex + 4;
-  indices[(*indices_count)++] = base_vertex + 5;
-
-  /* right edge (v1 -> v2) */
-  vertices[(*vertices_count)++] = x1;
-  vertices[(*vertices_count)++] = h10 - skirt_depth;
-  vertices[(*vertices_count)++] = z0;
-
-  vertices[(*vertices_count)++] = x1;
-  vertices[(*vertices_count)++] = h11 - skirt_depth;
-  vertices[(*vertices_count)++] = z1;
-
-  indices[(*indices_count)++] = base_vertex + 1;
-  indices[(*indices_count)++] = base_vertex + 2;
-  indices[(*indices_count)++] = base_vertex + 6;
-
-  indices[(*indices_count)++] = base_vertex + 2;
-  indices[(*indices_count)++] = base_vertex + 7;
-  indices[(*indices_count)++] = base_vertex + 6;
-
-  /* bottom edge (v0 -> v1) */
-  vertices[(*vertices_count)++] = x0;
-  vertices[(*vertices_count)++] = h00 - skirt_depth;
-  vertices[(*vertices_count)++] = z0;
-
-  vertices[(*vertices_count)++] = x1;
-  vertices[(*vertices_count)++] = h10 - skirt_depth;
-  vertices[(*vertices_count)++] = z0;
-
-  indices[(*indices_count)++] = base_vertex + 0;
-  indices[(*indices_count)++] = base_vertex + 1;
-  indices[(*indices_count)++] = base_vertex + 8;
-
-  indices[(*indices_count)++] = base_vertex + 1;
-  indices[(*indices_count)++] = base_vertex + 9;
-  indices[(*indices_count)++] = base_vertex + 8;
-
-  /* top edge (v3 -> v2) */
-  vertices[(*vertices_count)++] = x0;
-  vertices[(*vertices_count)++] = h01 - skirt_depth;
-  vertices[(*vertices_count)++] = z1;
-
-  vertices[(*vertices_count)++] = x1;
-  vertices[(*vertices_count)++] = h11 - skirt_depth;
-  vertices[(*vertices_count)++] = z1;
-
-  indices[(*indices_count)++] = base_vertex + 3;
-  indices[(*indices_count)++] = base_vertex + 10;
-  indices[(*indices_count)++] = base_vertex + 2;
-
-  indices[(*indices_count)++] = base_vertex + 2;
-  indices[(*indices_count)++] = base_vertex + 10;
-  indices[(*indices_count)++] = base_vertex + 11;
+  return fit;
 }
 
-/* quadtree traversal */
-/* iterative quadtree traversal using manual stack */
-CDLOD_API CDLOD_INLINE void cdlod_quadtree_traverse(
+/* generate quad patches (two triangles and skirts) for count nodes at once from
+ * already sampled corner heights (4 per node: x0z0, x1z0, x1z1, x0z1). writes
+ * as many patches as fit into the buffers and returns their number. uses the
+ * SSE2/NEON kernel when available, the output matches the scalar kernel exactly.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_generate_patches_sampled(
     float *vertices, int vertices_capacity, int *vertices_count,
     int *indices, int indices_capacity, int *indices_count,
-    cdlod_quadtree_node root,
-    float camera_x, float camera_y, float camera_z,
-    cdlod_height_function height,
-    int lod_count, float *lod_ranges_sq,
-    float patch_size, float skirt_depth)
+    cdlod_quadtree_node *nodes, float *heights, int count,
+    float skirt_depth)
 {
-  /* stack-based traversal */
-  cdlod_quadtree_node stack[64]; /* supports depth ~64, more than enough */
-  int stack_size = 0;
-
-  stack[stack_size++] = root;
+#if defined(CDLOD_SIMD_SSE2)
+  static const int pattern[30] = CDLOD_PATCH_INDICES;
+  float *v = vertices + *vertices_count;
+  int *idx = indices + *indices_count;
+  int base_vertex = *vertices_count / 3;
+  int fit = cdlod_patches_fit(vertices_capacity, *vertices_count, indices_capacity, *indices_count, count);
+  __m128 skirt = _mm_set1_ps(skirt_depth);
+  __m128i p0 = _mm_loadu_si128((const __m128i *)(pattern + 0));
+  __m128i p1 = _mm_loadu_si128((const __m128i *)(pattern + 4));
+  __m128i p2 = _mm_loadu_si128((const __m128i *)(pattern + 8));
+  __m128i p3 = _mm_loadu_si128((const __m128i *)(pattern + 12));
+  __m128i p4 = _mm_loadu_si128((const __m128i *)(pattern + 16));
+  __m128i p5 = _mm_loadu_si128((const __m128i *)(pattern + 20));
+  __m128i p6 = _mm_loadu_si128((const __m128i *)(pattern + 24));
+  int i;
 
-  while (stack_size > 0)
+  for (i = 0; i < fit; ++i)
   {
-    cdlod_quadtree_node node = stack[--stack_size];
-    float dx, dy, dz, dist;
-    int lod;
-    float max_size;
-    int i;
+    float half = nodes[i].size * 0.5f;
+    __m128i base = _mm_set1_epi32(base_vertex);
 
-    /* distance to node center */
-    dx = camera_x - node.x;
-    dy = camera_y - height(node.x, node.z);
-    dz = camera_z - node.z;
-    dist = dx * dx + dy * dy + dz * dz;
+    /* p = (x0, x1, z0, z1), h = (h00, h10, h11, h01), s = skirt heights */
+    __m128 p = _mm_add_ps(_mm_setr_ps(nodes[i].x, nodes[i].x, nodes[i].z, nodes[i].z),
+                          _mm_setr_ps(-half, half, -half, half));
+    __m128 h = _mm_loadu_ps(heights);
+    __m128 s = _mm_sub_ps(h, skirt);
+    __m128 hs = _mm_shuffle_ps(h, p, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 ss = _mm_shuffle_ps(s, p, _MM_SHUFFLE(3, 3, 2, 2));
+    __m128 w;
 
-    /* LOD selection: 0 = highest detail */
-    lod = 0;
-    while (lod + 1 < lod_count && dist > lod_ranges_sq[lod + 1])
-    {
-      lod++;
-    }
+    /* corners: x0 h00 z0 | x1 h10 z0 | x1 h11 z1 | x0 h01 z1 */
+    _mm_storeu_ps(v + 0, _mm_shuffle_ps(_mm_unpacklo_ps(p, h), p, _MM_SHUFFLE(1, 2, 1, 0)));
+    w = _mm_shuffle_ps(h, p, _MM_SHUFFLE(1, 2, 2, 1));
+    _mm_storeu_ps(v + 4, _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 3, 2, 0)));
+    _mm_storeu_ps(v + 8, _mm_shuffle_ps(p, hs, _MM_SHUFFLE(2, 0, 0, 3)));
+
+    /* skirts: same vertex order as the scalar kernel */
+    _mm_storeu_ps(v + 12, _mm_shuffle_ps(_mm_unpacklo_ps(p, s), p, _MM_SHUFFLE(0, 2, 1, 0)));
+    w = _mm_shuffle_ps(s, p, _MM_SHUFFLE(1, 3, 1, 3));
+    _mm_storeu_ps(v + 16, _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 3, 2, 0)));
+    _mm_storeu_ps(v + 20, _mm_shuffle_ps(p, ss, _MM_SHUFFLE(2, 0, 1, 2)));
+    _mm_storeu_ps(v + 24, _mm_shuffle_ps(_mm_unpacklo_ps(p, s), p, _MM_SHUFFLE(1, 2, 1, 0)));
+    w = _mm_shuffle_ps(s, p, _MM_SHUFFLE(0, 2, 3, 1));
+    _mm_storeu_ps(v + 28, _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 3, 2, 0)));
+    _mm_storeu_ps(v + 32, _mm_shuffle_ps(p, ss, _MM_SHUFFLE(2, 0, 1, 3)));
 
-    /* determine maximum allowed patch size for this LOD */
-    max_size = patch_size;
+    _mm_storeu_si128((__m128i *)(idx + 0), _mm_add_epi32(p0, base));
+    _mm_storeu_si128((__m128i *)(idx + 4), _mm_add_epi32(p1, base));
+    _mm_storeu_si128((__m128i *)(idx + 8), _mm_add_epi32(p2, base));
+    _mm_storeu_si128((__m128i *)(idx + 12), _mm_add_epi32(p3, base));
+    _mm_storeu_si128((__m128i *)(idx + 16), _mm_add_epi32(p4, base));
+    _mm_storeu_si128((__m128i *)(idx + 20), _mm_add_epi32(p5, base));
+    _mm_storeu_si128((__m128i *)(idx + 24), _mm_add_epi32(p6, base));
+    idx[28] = base_vertex + pattern[28];
+    idx[29] = base_vertex + pattern[29];
 
-    for (i = lod_count - 1; i > lod; --i)
+    v += 36;
+    idx += 30;
+    base_vertex += 12;
+    heights += 4;
+  }
+
+  *vertices_count += fit * 36;
+  *indices_count += fit * 30;
+
+  return fit;
+#elif defined(CDLOD_SIMD_NEON)
+  /* vst3q interleaves 4 vertices from x, y and z vectors */
+  static const int pattern[30] = CDLOD_PATCH_INDICES;
+  static const float sign_x[12] = {-1.0f, 1.0f, 1.0f, -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f};
+  static const float sign_z[12] = {-1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f};
+  float *v = vertices + *vertices_count;
+  int *idx = indices + *indices_count;
+  int base_vertex = *vertices_count / 3;
+  int fit = cdlod_patches_fit(vertices_capacity, *vertices_count, indices_capacity, *indices_count, count);
+  int i, j;
+
+  for (i = 0; i < fit; ++i)
+  {
+    float32x4_t half = vdupq_n_f32(nodes[i].size * 0.5f);
+    float32x4_t cx = vdupq_n_f32(nodes[i].x);
+    float32x4_t cz = vdupq_n_f32(nodes[i].z);
+    int32x4_t base = vdupq_n_s32(base_vertex);
+    float skirts[8];
+    float32x4x3_t out;
+
+    /* skirt heights in the order of the left/right and bottom/top skirt vertices */
+    skirts[0] = heights[0] - skirt_depth;
+    skirts[1] = heights[3] - skirt_depth;
+    skirts[2] = heights[1] - skirt_depth;
+    skirts[3] = heights[2] - skirt_depth;
+    skirts[4] = skirts[0];
+    skirts[5] = skirts[2];
+    skirts[6] = skirts[1];
+    skirts[7] = skirts[3];
+
+    for (j = 0; j < 3; ++j)
     {
-      max_size *= 0.5f; /* halve per step above current */
+      out.val[0] = vaddq_f32(cx, vmulq_f32(vld1q_f32(sign_x + j * 4), half));
+      out.val[1] = vld1q_f32(j == 0 ? heights : skirts + (j - 1) * 4);
+      out.val[2] = vaddq_f32(cz, vmulq_f32(vld1q_f32(sign_z + j * 4), half));
+      vst3q_f32(v + j * 12, out);
     }
 
-    /* leaf node: generate patch */
-    if (node.size <= max_size)
+    for (j = 0; j < 28; j += 4)
     {
-      cdlod_generate_patch(vertices, vertices_capacity, vertices_count,
-                           indices, indices_capacity, indices_count,
-                           &node, height, skirt_depth);
-      continue;
+      vst1q_s32(idx + j, vaddq_s32(vld1q_s32(pattern + j), base));
     }
+    idx[28] = base_vertex + pattern[28];
+    idx[29] = base_vertex + pattern[29];
 
-    /* subdivide into 4 children  & push children on stack */
-    if (stack_size + 4 <= 64)
-    {
-      float half = node.size * 0.5f;
+    v += 36;
+    idx += 30;
+    base_vertex += 12;
+    heights += 4;
+  }
 
-      stack[stack_size].x = node.x - half * 0.5f;
-      stack[stack_size].z = node.z - half * 0.5f;
-      stack[stack_size++].size = half;
+  *vertices_count += fit * 36;
+  *indices_count += fit * 30;
+
+  return fit;
+#else
+  return cdlod_generate_patches_scalar(vertices, vertices_capacity, vertices_count,
+                                       indices, indices_capacity, indices_count,
+                                       nodes, heights, count, skirt_depth);
+#endif
+}
 
-      stack[stack_size].x = node.x + half * 0.5f;
-      stack[stack_size].z = node.z - half * 0.5f;
-      stack[stack_size++].size = half;
+/* generate a single quad patch (two triangles) from already sampled corner
+ * heights, returns 0 if the buffers are full
+ */
+CDLOD_API CDLOD_INLINE int cdlod_generate_patch_sampled(
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_quadtree_node *node,
+    float h00, float h10, float h11, float h01,
+    float skirt_depth)
+{
+  float heights[4];
 
-      stack[stack_size].x = node.x + half * 0.5f;
-      stack[stack_size].z = node.z + half * 0.5f;
-      stack[stack_size++].size = half;
+  heights[0] = h00;
+  heights[1] = h10;
+  heights[2] = h11;
+  heights[3] = h01;
 
-      stack[stack_size].x = node.x - half * 0.5f;
-      stack[stack_size].z = node.z + half * 0.5f;
-      stack[stack_size++].size = half;
-    }
-  }
+  return cdlod_generate_patches_sampled(vertices, vertices_capacity, vertices_count,
+                                        indices, indices_capacity, indices_count,
+                                        node, heights, 1, skirt_depth);
 }
 
-CDLOD_API CDLOD_INLINE void cdlod(
+/* generate a single quad patch (two triangles), returns 0 if the buffers are full */
+CDLOD_API CDLOD_INLINE int cdlod_generate_patch(
     float *vertices, int vertices_capacity, int *vertices_count,
     int *indices, int indices_capacity, int *indices_count,
-    float camera_x, float camera_y, float camera_z,
-    float forward_x, float forward_z,
-    cdlod_height_function height,
-    float patch_size,
-    int lod_count,
-    float *lod_ranges,
-    int grid_radius,
-    float skirt_depth)
+    cdlod_quadtree_node *node, cdlod_height_function height, float skirt_depth)
 {
-  int gx, gz;
-  int grid_center_x, grid_center_z;
-  float lod_ranges_sq[CDLOD_MAX_LODS];
-  int i;
+  float half = node->size * 0.5f;
+  float x0 = node->x - half;
+  float x1 = node->x + half;
+  float z0 = node->z - half;
+  float z1 = node->z + half;
 
-  float fx = forward_x;
-  float fz = forward_z;
-  float len;
-  float offset_x, offset_z;
+  return cdlod_generate_patch_sampled(vertices, vertices_capacity, vertices_count,
+                                      indices, indices_capacity, indices_count,
+                                      node,
+                                      height(x0, z0), height(x1, z0),
+                                      height(x1, z1), height(x0, z1),
+                                      skirt_depth);
+}
 
-  cdlod_quadtree_node root;
+/* number of vertices written by cdlod_generate_grid_patch (grid + one skirt ring) */
+CDLOD_API CDLOD_INLINE int cdlod_grid_patch_vertex_count(int patch_resolution)
+{
+  return patch_resolution * patch_resolution + 4 * (patch_resolution - 1);
+}
 
-  /* reset counts */
-  *vertices_count = 0;
-  *indices_count = 0;
+/* number of indices written by cdlod_generate_grid_patch (grid + one skirt ring) */
+CDLOD_API CDLOD_INLINE int cdlod_grid_patch_index_count(int patch_resolution)
+{
+  return ((patch_resolution - 1) * (patch_resolution - 1) + 4 * (patch_resolution - 1)) * 6;
+}
 
-  /* pre-cache lod_ranges squared assuming lod_count <= CDLOD_MAX_LODS */
-  for (i = 0; i < lod_count; ++i)
+/* vertex count of a grid patch with skirts or stitched seams (no skirt ring) */
+CDLOD_API CDLOD_INLINE int cdlod_grid_patch_vertex_count_seams(int patch_resolution, int stitched)
+{
+  return stitched ? patch_resolution * patch_resolution : cdlod_grid_patch_vertex_count(patch_resolution);
+}
+
+/* index count of a grid patch with skirts, or the maximum of a stitched one
+ * (stitched edges drop triangles)
+ */
+CDLOD_API CDLOD_INLINE int cdlod_grid_patch_index_count_seams(int patch_resolution, int stitched)
+{
+  return stitched ? (patch_resolution - 1) * (patch_resolution - 1) * 6 : cdlod_grid_patch_index_count(patch_resolution);
+}
+
+/* row major index of grid vertex (x, z) of a stitched patch: border vertices
+ * between two used ones (steps per edge, see cdlod_generate_grid_patch_layout)
+ * collapse onto the previous used vertex of their edge
+ */
+CDLOD_API CDLOD_INLINE int cdlod_grid_stitch_vertex(int patch_resolution, int *steps, int x, int z)
+{
+  int quads = patch_resolution - 1;
+
+  if (x == 0)
+  {
+    z -= z % steps[CDLOD_EDGE_LEFT];
+  }
+  else if (x == quads)
+  {
+    z -= z % steps[CDLOD_EDGE_RIGHT];
+  }
+  else if (z == 0)
   {
-    lod_ranges_sq[i] = lod_ranges[i] * lod_ranges[i];
+    x -= x % steps[CDLOD_EDGE_BOTTOM];
+  }
+  else if (z == quads)
+  {
+    x -= x % steps[CDLOD_EDGE_TOP];
   }
 
-  /* normalize forward vector (XZ only) */
-  len = (float)(fx * fx + fz * fz);
+  return z * patch_resolution + x;
+}
 
-  if (len > 0.0001f)
+/* map a position on the border ring to its row major grid vertex index.
+ * the ring starts at (x0, z0) and walks left -> top -> right -> bottom edge so
+ * that skirt triangles built along it face outwards.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_grid_ring_vertex(int patch_resolution, int r)
+{
+  int quads = patch_resolution - 1;
+
+  if (r < quads)
   {
-    len = 1.0f / cdlod_sqrtf(len);
-    fx *= len;
-    fz *= len;
+    return r * patch_resolution; /* left edge, z ascending */
   }
-  else
+  else if (r < 2 * quads)
   {
-    fx = 0.0f;
-    fz = 1.0f; /* default forward = +Z */
+    return quads * patch_resolution + (r - quads); /* top edge, x ascending */
+  }
+  else if (r < 3 * quads)
+  {
+    return (quads - (r - 2 * quads)) * patch_resolution + quads; /* right edge, z descending */
   }
 
-  /* compute forward shift in patch units */
-  offset_x = fx * (float)(grid_radius - 1);
-  offset_z = fz * (float)(grid_radius - 1);
+  return quads - (r - 3 * quads); /* bottom edge, x descending */
+}
 
-  /* find grid center in patch coords */
-  grid_center_x = (int)(camera_x / patch_size + offset_x);
-  grid_center_z = (int)(camera_z / patch_size + offset_z);
+/* camera distance based morph factor in [0, 1] for a node's morph range */
+CDLOD_API CDLOD_INLINE float cdlod_morph_factor(
+    cdlod_node *node,
+    float camera_x, float camera_y, float camera_z,
+    float x, float y, float z)
+{
+  float dx = camera_x - x;
+  float dy = camera_y - y;
+  float dz = camera_z - z;
+  float dist_sq = dx * dx + dy * dy + dz * dz;
+  float k;
 
-  for (gx = -grid_radius; gx <= grid_radius; ++gx)
+  if (dist_sq <= node->morph_start * node->morph_start)
   {
-    for (gz = -grid_radius; gz <= grid_radius; ++gz)
-    {
-      root.x = (float)(grid_center_x + gx) * patch_size + patch_size * 0.5f;
-      root.z = (float)(grid_center_z + gz) * patch_size + patch_size * 0.5f;
-      root.size = patch_size;
+    return 0.0f;
+  }
 
-      cdlod_quadtree_traverse(vertices, vertices_capacity, vertices_count,
-                              indices, indices_capacity, indices_count,
-                              root, camera_x, camera_y, camera_z,
-                              height, lod_count, lod_ranges_sq,
-                              patch_size, skirt_depth);
-    }
+  if (dist_sq >= node->morph_end * node->morph_end)
+  {
+    return 1.0f;
   }
+
+  k = (cdlod_sqrtf(dist_sq) - node->morph_start) / (node->morph_end - node->morph_start);
+
+  return k < 0.0f ? 0.0f : (k > 1.0f ? 1.0f : k);
+}
+
+/* vertex layout
+ *
+ * every attribute is a pointer to its first float and the distance in floats
+ * from one vertex to the next, so the same descriptor covers interleaved
+ * buffers (one base pointer, common stride, per attribute offsets) and
+ * structure of arrays streams (one array per component, stride 1).
+ */
+typedef struct cdlod_attribute
+{
+  float *data; /* first float of vertex 0, 0 = attribute not written */
+  int stride;  /* floats between two consecutive vertices */
+
+} cdlod_attribute;
+
+typedef struct cdlod_layout
+{
+  cdlod_attribute x, y, z; /* position (required) */
+  cdlod_attribute normal;  /* optional, 3 consecutive floats (unit length) */
+  cdlod_attribute tangent; /* optional, 3 consecutive floats (unit length, along +x) */
+  cdlod_attribute uv;      /* optional, 2 consecutive floats ([0, 1] across the node) */
+  cdlod_attribute morph;   /* optional, morph factor (CDLOD_MORPH_FACTOR) */
+
+  int capacity; /* vertices */
+  int count;    /* vertices written */
+
+} cdlod_layout;
+
+/* interleaved layout: position at offset 0, optional attributes at the given
+ * float offsets (-1 = not written), stride floats per vertex. a tangent can be
+ * added afterwards (layout.tangent.data = vertices + offset).
+ */
+CDLOD_API CDLOD_INLINE void cdlod_layout_interleaved(
+    cdlod_layout *layout, float *vertices, int vertices_capacity, int stride,
+    int normal_offset, int uv_offset, int morph_offset)
+{
+  layout->x.data = vertices;
+  layout->y.data = vertices + 1;
+  layout->z.data = vertices + 2;
+  layout->normal.data = normal_offset < 0 ? 0 : vertices + normal_offset;
+  layout->tangent.data = 0;
+  layout->uv.data = uv_offset < 0 ? 0 : vertices + uv_offset;
+  layout->morph.data = morph_offset < 0 ? 0 : vertices + morph_offset;
+
+  layout->x.stride = stride;
+  layout->y.stride = stride;
+  layout->z.stride = stride;
+  layout->normal.stride = stride;
+  layout->tangent.stride = stride;
+  layout->uv.stride = stride;
+  layout->morph.stride = stride;
+
+  layout->capacity = vertices_capacity / stride;
+  layout->count = 0;
+}
+
+/* structure of arrays layout: one array per position component (optional
+ * attributes can be set afterwards, e.g. layout.morph.data = k; layout.morph.stride = 1)
+ */
+CDLOD_API CDLOD_INLINE void cdlod_layout_soa(
+    cdlod_layout *layout, float *x, float *y, float *z, int capacity)
+{
+  layout->x.data = x;
+  layout->y.data = y;
+  layout->z.data = z;
+  layout->normal.data = 0;
+  layout->tangent.data = 0;
+  layout->uv.data = 0;
+  layout->morph.data = 0;
+
+  layout->x.stride = 1;
+  layout->y.stride = 1;
+  layout->z.stride = 1;
+  layout->normal.stride = 3;
+  layout->tangent.stride = 3;
+  layout->uv.stride = 2;
+  layout->morph.stride = 1;
+
+  layout->capacity = capacity;
+  layout->count = 0;
+}
+
+/* first float of a vertex attribute */
+CDLOD_API CDLOD_INLINE float *cdlod_attribute_at(cdlod_attribute *attribute, int vertex)
+{
+  return attribute->data + vertex * attribute->stride;
+}
+
+/* quads per band of the grid index order (see CDLOD_VERTEX_CACHE_SIZE) */
+CDLOD_API CDLOD_INLINE int cdlod_grid_band_width(void)
+{
+  return CDLOD_VERTEX_CACHE_SIZE / 2 - 1 > 0 ? CDLOD_VERTEX_CACHE_SIZE / 2 - 1 : 1;
+}
+
+/* generate a grid patch of patch_resolution x patch_resolution shared vertices
+ * (indexed triangles) surrounded by a single skirt ring.
+ *
+ * vertex layout: grid vertices row by row (index = z * patch_resolution + x),
+ * followed by the skirt ring in cdlod_grid_ring_vertex order.
+ *
+ * geomorphing (morph_mode != CDLOD_MORPH_NONE) uses the CDLOD morph formula:
+ * every vertex gets k = clamp((dist - morph_start) / (morph_end - morph_start))
+ * from its camera distance. at k = 1 odd grid vertices collapse onto their even
+ * neighbour so the patch exactly matches the next coarser lod. this requires an
+ * even number of quads per side (patch_resolution = 2^n + 1, e.g. 17 or 33).
+ *
+ * stitched nodes (node->seams, see CDLOD_SEAMS_STITCHED) have no skirt ring.
+ * on edges that border a coarser node every odd border vertex is skipped
+ * (collapsed onto the previous even one), so the edge only uses vertices of
+ * the coarser neighbour and has no T-junctions. the grid vertices are still
+ * all written, the skipped ones are just not referenced.
+ *
+ * normals and tangents (if requested) come from central differences of the
+ * unmorphed heights. border vertices use one extra sample outside of the patch,
+ * which is the vertex a same lod neighbour patch shares, so normals match
+ * across patch borders. skirt vertices copy all attributes of their border vertex.
+ *
+ * returns 0 if the buffers are full.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_generate_grid_patch_layout(
+    cdlod_layout *layout,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *node, cdlod_height_source *height, float skirt_depth,
+    int patch_resolution,
+    cdlod_morph_mode morph_mode,
+    float camera_x, float camera_y, float camera_z)
+{
+  int base_vertex, skirt_vertex;
+  int quads, ring, grid_vertices;
+  int x, z, r, i;
+  int band, band_width = cdlod_grid_band_width();
+  int stitched = node->seams & CDLOD_SEAMS_STITCHED;
+  int steps[4];
+  float half, step;
+  float x0, z0;
+  int *idx;
+
+  quads = patch_resolution - 1;
+  ring = stitched ? 0 : 4 * quads;
+  grid_vertices = patch_resolution * patch_resolution;
+
+  /* check capacity */
+  if (patch_resolution < 2 ||
+      layout->count + cdlod_grid_patch_vertex_count_seams(patch_resolution, stitched) > layout->capacity ||
+      *indices_count + cdlod_grid_patch_index_count_seams(patch_resolution, stitched) > indices_capacity)
+  {
+    return 0;
+  }
+
+  /* border vertex step per edge: 2^lod difference, as far as the quads divide */
+  for (i = 0; i < 4; ++i)
+  {
+    steps[i] = stitched ? 1 << cdlod_node_seam(node, i) : 1;
+
+    while (steps[i] > 1 && quads % steps[i])
+    {
+      steps[i] >>= 1;
+    }
+  }
+
+  base_vertex = layout->count;
+  skirt_vertex = base_vertex + grid_vertices;
+
+  half = node->size * 0.5f;
+  step = node->size / (float)quads;
+  x0 = node->x - half;
+  z0 = node->z - half;
+
+  /* grid vertices (one height sample per shared vertex, sampled in batches) */
+  for (i = 0; i < grid_vertices; i += CDLOD_HEIGHT_BATCH_SIZE)
+  {
+    float xs[CDLOD_HEIGHT_BATCH_SIZE];
+    float zs[CDLOD_HEIGHT_BATCH_SIZE];
+    float hs[CDLOD_HEIGHT_BATCH_SIZE];
+    int n = grid_vertices - i;
+    int j;
+
+    n = n > CDLOD_HEIGHT_BATCH_SIZE ? CDLOD_HEIGHT_BATCH_SIZE : n;
+
+    for (j = 0; j < n; ++j)
+    {
+      xs[j] = x0 + (float)((i + j) % patch_resolution) * step;
+      zs[j] = z0 + (float)((i + j) / patch_resolution) * step;
+    }
+
+    cdlod_height_source_sample(height, xs, zs, hs, n);
+
+    for (j = 0; j < n; ++j)
+    {
+      *cdlod_attribute_at(&layout->x, base_vertex + i + j) = xs[j];
+      *cdlod_attribute_at(&layout->y, base_vertex + i + j) = hs[j];
+      *cdlod_attribute_at(&layout->z, base_vertex + i + j) = zs[j];
+    }
+  }
+
+  /* normals and tangents from central differences */
+  if (layout->normal.data || layout->tangent.data)
+  {
+    /* gradients (dh/dx, dh/dz) are kept in the first and last float of either
+     * attribute until all of them are known
+     */
+    cdlod_attribute *gradient = layout->normal.data ? &layout->normal : &layout->tangent;
+    float inv_step2 = 0.5f / step;
+    int side;
+
+    for (z = 0; z < patch_resolution; ++z)
+    {
+      for (x = 0; x < patch_resolution; ++x)
+      {
+        int v = base_vertex + z * patch_resolution + x;
+        float *g = cdlod_attribute_at(gradient, v);
+
+        /* border components are replaced below */
+        g[0] = x > 0 && x < quads
+                   ? (*cdlod_attribute_at(&layout->y, v + 1) - *cdlod_attribute_at(&layout->y, v - 1)) * inv_step2
+                   : 0.0f;
+        g[2] = z > 0 && z < quads
+                   ? (*cdlod_attribute_at(&layout->y, v + patch_resolution) - *cdlod_attribute_at(&layout->y, v - patch_resolution)) * inv_step2
+                   : 0.0f;
+      }
+    }
+
+    /* borders: one sample outside of the patch per border vertex (left, right, bottom, top) */
+    for (side = 0; side < 4; ++side)
+    {
+      for (i = 0; i < patch_resolution; i += CDLOD_HEIGHT_BATCH_SIZE)
+      {
+        float xs[CDLOD_HEIGHT_BATCH_SIZE];
+        float zs[CDLOD_HEIGHT_BATCH_SIZE];
+        float hs[CDLOD_HEIGHT_BATCH_SIZE];
+        int n = patch_resolution - i;
+        int j;
+
+        n = n > CDLOD_HEIGHT_BATCH_SIZE ? CDLOD_HEIGHT_BATCH_SIZE : n;
+
+        for (j = 0; j < n; ++j)
+        {
+          float along = (float)(i + j) * step;
+
+          xs[j] = side == 0 ? x0 - step : (side == 1 ? x0 + node->size + step : x0 + along);
+          zs[j] = side == 2 ? z0 - step : (side == 3 ? z0 + node->size + step : z0 + along);
+        }
+
+        cdlod_height_source_sample(height, xs, zs, hs, n);
+
+        for (j = 0; j < n; ++j)
+        {
+          int k = i + j;
+          int inner;
+          int v;
+
+          if (side < 2)
+          {
+            /* left/right border: x = 0 or x = quads, k = z */
+            v = base_vertex + k * patch_resolution + (side == 0 ? 0 : quads);
+            inner = side == 0 ? v + 1 : v - 1;
+
+            cdlod_attribute_at(gradient, v)[0] = side == 0
+                                                     ? (*cdlod_attribute_at(&layout->y, inner) - hs[j]) * inv_step2
+                                                     : (hs[j] - *cdlod_attribute_at(&layout->y, inner)) * inv_step2;
+          }
+          else
+          {
+            /* bottom/top border: z = 0 or z = quads, k = x */
+            v = base_vertex + (side == 2 ? 0 : quads) * patch_resolution + k;
+            inner = side == 2 ? v + patch_resolution : v - patch_resolution;
+
+            cdlod_attribute_at(gradient, v)[2] = side == 2
+                                                     ? (*cdlod_attribute_at(&layout->y, inner) - hs[j]) * inv_step2
+                                                     : (hs[j] - *cdlod_attribute_at(&layout->y, inner)) * inv_step2;
+          }
+        }
+      }
+    }
+
+    for (i = 0; i < grid_vertices; ++i)
+    {
+      float *g = cdlod_attribute_at(gradient, base_vertex + i);
+      float dx = g[0];
+      float dz = g[2];
+
+      if (layout->tangent.data)
+      {
+        float *t = cdlod_attribute_at(&layout->tangent, base_vertex + i);
+        float inv_len = cdlod_invsqrt(1.0f + dx * dx);
+
+        t[0] = inv_len;
+        t[1] = dx * inv_len;
+        t[2] = 0.0f;
+      }
+
+      if (layout->normal.data)
+      {
+        float *n = cdlod_attribute_at(&layout->normal, base_vertex + i);
+        float inv_len = cdlod_invsqrt(dx * dx + 1.0f + dz * dz);
+
+        n[0] = -dx * inv_len;
+        n[1] = inv_len;
+        n[2] = -dz * inv_len;
+      }
+    }
+  }
+
+  if (layout->uv.data)
+  {
+    for (i = 0; i < grid_vertices; ++i)
+    {
+      float *uv = cdlod_attribute_at(&layout->uv, base_vertex + i);
+
+      uv[0] = (float)(i % patch_resolution) / (float)quads;
+      uv[1] = (float)(i / patch_resolution) / (float)quads;
+    }
+  }
+
+  /* geomorphing: only odd vertices move and only towards even vertices which
+   * never move themselves, so the grid can be morphed in place in any order
+   */
+  if (morph_mode != CDLOD_MORPH_NONE)
+  {
+    for (z = 0; z < patch_resolution; ++z)
+    {
+      for (x = 0; x < patch_resolution; ++x)
+      {
+        int v = base_vertex + z * patch_resolution + x;
+        float *px = cdlod_attribute_at(&layout->x, v);
+        float *py = cdlod_attribute_at(&layout->y, v);
+        float *pz = cdlod_attribute_at(&layout->z, v);
+        float k = cdlod_morph_factor(node, camera_x, camera_y, camera_z, *px, *py, *pz);
+
+        if (morph_mode == CDLOD_MORPH_FACTOR)
+        {
+          if (layout->morph.data)
+          {
+            *cdlod_attribute_at(&layout->morph, v) = k;
+          }
+        }
+        else if (k > 0.0f && ((x | z) & 1))
+        {
+          /* slide towards the even (coarser lod) vertex at or below this one */
+          int tx = x & ~1;
+          int tz = z & ~1;
+          float ty = *cdlod_attribute_at(&layout->y, base_vertex + tz * patch_resolution + tx);
+
+          *px -= (float)(x - tx) * step * k;
+          *py += (ty - *py) * k;
+          *pz -= (float)(z - tz) * step * k;
+        }
+      }
+    }
+  }
+
+  /* skirt ring vertices (reuse the already sampled border heights) */
+  for (r = 0; r < ring; ++r)
+  {
+    int g = base_vertex + cdlod_grid_ring_vertex(patch_resolution, r);
+    int v = skirt_vertex + r;
+
+    *cdlod_attribute_at(&layout->x, v) = *cdlod_attribute_at(&layout->x, g);
+    *cdlod_attribute_at(&layout->y, v) = *cdlod_attribute_at(&layout->y, g) - skirt_depth;
+    *cdlod_attribute_at(&layout->z, v) = *cdlod_attribute_at(&layout->z, g);
+
+    if (layout->normal.data)
+    {
+      float *n = cdlod_attribute_at(&layout->normal, v);
+      float *gn = cdlod_attribute_at(&layout->normal, g);
+
+      n[0] = gn[0];
+      n[1] = gn[1];
+      n[2] = gn[2];
+    }
+
+    if (layout->tangent.data)
+    {
+      float *t = cdlod_attribute_at(&layout->tangent, v);
+      float *gt = cdlod_attribute_at(&layout->tangent, g);
+
+      t[0] = gt[0];
+      t[1] = gt[1];
+      t[2] = gt[2];
+    }
+
+    if (layout->uv.data)
+    {
+      float *uv = cdlod_attribute_at(&layout->uv, v);
+      float *guv = cdlod_attribute_at(&layout->uv, g);
+
+      uv[0] = guv[0];
+      uv[1] = guv[1];
+    }
+
+    if (morph_mode == CDLOD_MORPH_FACTOR && layout->morph.data)
+    {
+      *cdlod_attribute_at(&layout->morph, v) = *cdlod_attribute_at(&layout->morph, g);
+    }
+  }
+
+  /* grid indices (CCW winding), band by band (see CDLOD_VERTEX_CACHE_SIZE) */
+  idx = indices + *indices_count;
+
+  for (band = 0; band < quads; band += band_width)
+  {
+    int band_end = band + band_width < quads ? band + band_width : quads;
+
+    for (z = 0; z < quads; ++z)
+    {
+      for (x = band; x < band_end; ++x)
+      {
+        int i00 = base_vertex + z * patch_resolution + x;
+        int i10 = i00 + 1;
+        int i01 = i00 + patch_resolution;
+        int i11 = i01 + 1;
+
+        /* stitched border cells: collapse skipped vertices, drop degenerate triangles */
+        if (stitched && (x == 0 || z == 0 || x + 1 == quads || z + 1 == quads))
+        {
+          i00 = base_vertex + cdlod_grid_stitch_vertex(patch_resolution, steps, x, z);
+          i10 = base_vertex + cdlod_grid_stitch_vertex(patch_resolution, steps, x + 1, z);
+          i01 = base_vertex + cdlod_grid_stitch_vertex(patch_resolution, steps, x, z + 1);
+          i11 = base_vertex + cdlod_grid_stitch_vertex(patch_resolution, steps, x + 1, z + 1);
+
+          if (i00 != i11 && i00 != i10 && i11 != i10)
+          {
+            *idx++ = i00;
+            *idx++ = i11;
+            *idx++ = i10;
+          }
+
+          if (i00 != i01 && i00 != i11 && i01 != i11)
+          {
+            *idx++ = i00;
+            *idx++ = i01;
+            *idx++ = i11;
+          }
+          continue;
+        }
+
+        *idx++ = i00;
+        *idx++ = i11;
+        *idx++ = i10;
+
+        *idx++ = i00;
+        *idx++ = i01;
+        *idx++ = i11;
+      }
+    }
+  }
+
+  /* skirt indices: each ring edge = 2 triangles facing outwards */
+  for (r = 0; r < ring; ++r)
+  {
+    int rn = (r + 1 == ring) ? 0 : r + 1;
+    int g0 = cdlod_grid_ring_vertex(patch_resolution, r);
+    int g1 = cdlod_grid_ring_vertex(patch_resolution, rn);
+
+    *idx++ = base_vertex + g0;
+    *idx++ = skirt_vertex + r;
+    *idx++ = base_vertex + g1;
+
+    *idx++ = base_vertex + g1;
+    *idx++ = skirt_vertex + r;
+    *idx++ = skirt_vertex + rn;
+  }
+
+  layout->count = skirt_vertex + ring;
+  *indices_count = (int)(idx - indices);
+
+  return 1;
+}
+
+/* cdlod_generate_grid_patch_layout() into an interleaved float buffer: xyz, plus
+ * the morph factor as 4th float in CDLOD_MORPH_FACTOR mode. counts are in floats.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_generate_grid_patch(
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *node, cdlod_height_source *height, float skirt_depth,
+    int patch_resolution,
+    cdlod_morph_mode morph_mode,
+    float camera_x, float camera_y, float camera_z)
+{
+  int stride = (morph_mode == CDLOD_MORPH_FACTOR) ? 4 : 3;
+  cdlod_layout layout;
+
+  cdlod_layout_interleaved(&layout, vertices, vertices_capacity, stride,
+                           -1, -1, stride == 4 ? 3 : -1);
+  layout.count = *vertices_count / stride;
+
+  if (!cdlod_generate_grid_patch_layout(&layout,
+                                        indices, indices_capacity, indices_count,
+                                        node, height, skirt_depth,
+                                        patch_resolution, morph_mode,
+                                        camera_x, camera_y, camera_z))
+  {
+    return 0;
+  }
+
+  *vertices_count = layout.count * stride;
+
+  return 1;
+}
+
+/* number of indices written by cdlod_generate_grid_patch_strip() */
+CDLOD_API CDLOD_INLINE int cdlod_grid_patch_strip_index_count(int patch_resolution)
+{
+  int quads = patch_resolution - 1;
+  int bands = (quads + cdlod_grid_band_width() - 1) / cdlod_grid_band_width();
+
+  /* per band row 2 * (quads + 1) and a restart, the skirt ring as one strip */
+  return quads * (2 * quads + 3 * bands) + 2 * (4 * quads + 1) + 1;
+}
+
+/* triangle strip indices with primitive restart for a grid patch with skirts
+ * (vertices of cdlod_generate_grid_patch at base_vertex), e.g. for the static
+ * mesh of instanced rendering. the same band order as the triangle list, one
+ * strip per band row and one around the skirt ring, each terminated by
+ * restart_index (e.g. 0xFFFF for 16 bit or -1 for 32 bit index buffers). the
+ * strips split the grid cells along the other diagonal. stitched patches have
+ * no strip form. returns 0 if indices is full.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_generate_grid_patch_strip(
+    int *indices, int indices_capacity, int *indices_count,
+    int base_vertex, int patch_resolution, int restart_index)
+{
+  int quads = patch_resolution - 1;
+  int ring = 4 * quads;
+  int skirt_vertex = base_vertex + patch_resolution * patch_resolution;
+  int band_width = cdlod_grid_band_width();
+  int band, x, z, r;
+  int *idx;
+
+  if (patch_resolution < 2 ||
+      *indices_count + cdlod_grid_patch_strip_index_count(patch_resolution) > indices_capacity)
+  {
+    return 0;
+  }
+
+  idx = indices + *indices_count;
+
+  for (band = 0; band < quads; band += band_width)
+  {
+    int band_end = band + band_width < quads ? band + band_width : quads;
+
+    for (z = 0; z < quads; ++z)
+    {
+      for (x = band; x <= band_end; ++x)
+      {
+        *idx++ = base_vertex + z * patch_resolution + x;
+        *idx++ = base_vertex + (z + 1) * patch_resolution + x;
+      }
+
+      *idx++ = restart_index;
+    }
+  }
+
+  for (r = 0; r <= ring; ++r)
+  {
+    int ring_index = r == ring ? 0 : r;
+
+    *idx++ = base_vertex + cdlod_grid_ring_vertex(patch_resolution, ring_index);
+    *idx++ = skirt_vertex + ring_index;
+  }
+
+  *idx++ = restart_index;
+
+  *indices_count = (int)(idx - indices);
+
+  return 1;
+}
+
+/* extract the 6 frustum planes (left, right, bottom, top, near, far) from a
+ * column major view projection matrix with OpenGL clip space (-w <= z <= w).
+ * each plane is (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frustum_from_matrix(float planes[6 * 4], float *view_projection)
+{
+  float *m = view_projection;
+  int i;
+
+  for (i = 0; i < 4; ++i)
+  {
+    float row0 = m[i * 4 + 0];
+    float row1 = m[i * 4 + 1];
+    float row2 = m[i * 4 + 2];
+    float row3 = m[i * 4 + 3];
+
+    planes[0 * 4 + i] = row3 + row0; /* left   */
+    planes[1 * 4 + i] = row3 - row0; /* right  */
+    planes[2 * 4 + i] = row3 + row1; /* bottom */
+    planes[3 * 4 + i] = row3 - row1; /* top    */
+    planes[4 * 4 + i] = row3 + row2; /* near   */
+    planes[5 * 4 + i] = row3 - row2; /* far    */
+  }
+}
+
+/* returns 1 if the axis aligned box is completely outside of one of the planes */
+CDLOD_API CDLOD_INLINE int cdlod_frustum_cull_box(
+    float *planes,
+    float min_x, float min_y, float min_z,
+    float max_x, float max_y, float max_z)
+{
+  int i;
+
+  for (i = 0; i < 6; ++i)
+  {
+    float *p = planes + i * 4;
+
+    /* test the box corner furthest along the plane normal */
+    float x = p[0] >= 0.0f ? max_x : min_x;
+    float y = p[1] >= 0.0f ? max_y : min_y;
+    float z = p[2] >= 0.0f ? max_z : min_z;
+
+    if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f)
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* min/max height pyramid
+ *
+ * precomputed height bounds for every quadtree node of a rectangular area of
+ * root patches (one level per lod). lets the traversal use the true distance to
+ * a node's bounding box and tight culling bounds without calling the height
+ * function. the data is caller provided (see cdlod_height_pyramid_memory_size).
+ */
+typedef struct cdlod_height_pyramid
+{
+  int origin_x, origin_z; /* min corner in root patch coordinates */
+  int roots_x, roots_z;   /* covered area in root patches */
+  float patch_size;       /* root patch size (must match the frame) */
+  int lod_count;          /* number of levels (must match the frame) */
+  int samples;            /* height samples per side of a finest level node */
+
+  float *data; /* min/max pairs, finest level first, row major per level */
+  int level_offset[CDLOD_MAX_LODS];
+  int level_width[CDLOD_MAX_LODS];
+
+  /* ring buffer position of the origin root (see cdlod_height_pyramid_scroll) */
+  int wrap_x, wrap_z;
+
+} cdlod_height_pyramid;
+
+/* number of floats required for the pyramid data */
+CDLOD_API CDLOD_INLINE int cdlod_height_pyramid_memory_size(int roots_x, int roots_z, int lod_count)
+{
+  int size = 0;
+  int lod;
+
+  for (lod = 0; lod < lod_count; ++lod)
+  {
+    int nodes_per_root = 1 << (lod_count - 1 - lod);
+    size += (roots_x * nodes_per_root) * (roots_z * nodes_per_root) * 2;
+  }
+
+  return size;
+}
+
+/* sets up the pyramid layout, returns 0 if data_capacity (in floats) is too small.
+ * samples is the number of height samples per node side on the finest level and
+ * should match the emitted patches (patch_resolution, or 2 for single quads).
+ */
+CDLOD_API CDLOD_INLINE int cdlod_height_pyramid_init(
+    cdlod_height_pyramid *pyramid,
+    float *data, int data_capacity,
+    int origin_x, int origin_z,
+    int roots_x, int roots_z,
+    float patch_size, int lod_count,
+    int samples)
+{
+  int offset = 0;
+  int lod;
+
+  if (lod_count < 1 || lod_count > CDLOD_MAX_LODS ||
+      cdlod_height_pyramid_memory_size(roots_x, roots_z, lod_count) > data_capacity)
+  {
+    return 0;
+  }
+
+  pyramid->origin_x = origin_x;
+  pyramid->origin_z = origin_z;
+  pyramid->roots_x = roots_x;
+  pyramid->roots_z = roots_z;
+  pyramid->patch_size = patch_size;
+  pyramid->lod_count = lod_count;
+  pyramid->samples = samples < 2 ? 2 : samples;
+  pyramid->data = data;
+  pyramid->wrap_x = 0;
+  pyramid->wrap_z = 0;
+
+  for (lod = 0; lod < lod_count; ++lod)
+  {
+    int nodes_per_root = 1 << (lod_count - 1 - lod);
+
+    pyramid->level_offset[lod] = offset;
+    pyramid->level_width[lod] = roots_x * nodes_per_root;
+    offset += (roots_x * nodes_per_root) * (roots_z * nodes_per_root) * 2;
+  }
+
+  return 1;
+}
+
+/* min/max pair of node (x, z) of a level relative to the origin. the roots are
+ * stored as a ring buffer, whole roots wrap so children stay next to each other.
+ */
+CDLOD_API CDLOD_INLINE float *cdlod_height_pyramid_bounds(cdlod_height_pyramid *pyramid, int lod, int x, int z)
+{
+  int nodes_per_root = 1 << (pyramid->lod_count - 1 - lod);
+  int width = pyramid->level_width[lod];
+  int depth = pyramid->roots_z * nodes_per_root;
+
+  x += pyramid->wrap_x * nodes_per_root;
+  z += pyramid->wrap_z * nodes_per_root;
+  x = x >= width ? x - width : x;
+  z = z >= depth ? z - depth : z;
+
+  return pyramid->data + pyramid->level_offset[lod] + (z * width + x) * 2;
+}
+
+/* recompute the given node range of a level (inclusive). heights are sampled
+ * through the same source as the patches (e.g. &frame.height), so batch
+ * callbacks, heightmaps and world positions give the pyramid the heights of
+ * the emitted patches.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_height_pyramid_fit_level(
+    cdlod_height_pyramid *pyramid, cdlod_height_source *height, int lod,
+    int x0, int z0, int x1, int z1)
+{
+  float xs[CDLOD_HEIGHT_BATCH_SIZE];
+  float zs[CDLOD_HEIGHT_BATCH_SIZE];
+  float hs[CDLOD_HEIGHT_BATCH_SIZE];
+  int x, z;
+
+  for (z = z0; z <= z1; ++z)
+  {
+    for (x = x0; x <= x1; ++x)
+    {
+      float *bounds = cdlod_height_pyramid_bounds(pyramid, lod, x, z);
+      float min, max;
+
+      if (lod == 0)
+      {
+        /* finest level: sample the node like an emitted patch */
+        int quads = pyramid->samples - 1;
+        float size = pyramid->patch_size / (float)(1 << (pyramid->lod_count - 1));
+        float step = size / (float)quads;
+        float nx = (float)pyramid->origin_x * pyramid->patch_size + (float)x * size;
+        float nz = (float)pyramid->origin_z * pyramid->patch_size + (float)z * size;
+        int sx, sz, n, i;
+
+        min = 3.402823466e+38f;
+        max = -3.402823466e+38f;
+
+        /* one row at a time, in batches */
+        for (sz = 0; sz <= quads; ++sz)
+        {
+          for (sx = 0; sx <= quads; sx += n)
+          {
+            n = quads + 1 - sx;
+            n = n > CDLOD_HEIGHT_BATCH_SIZE ? CDLOD_HEIGHT_BATCH_SIZE : n;
+
+            for (i = 0; i < n; ++i)
+            {
+              xs[i] = nx + (float)(sx + i) * step;
+              zs[i] = nz + (float)sz * step;
+            }
+
+            cdlod_height_source_sample(height, xs, zs, hs, n);
+
+            for (i = 0; i < n; ++i)
+            {
+              min = hs[i] < min ? hs[i] : min;
+              max = hs[i] > max ? hs[i] : max;
+            }
+          }
+        }
+      }
+      else
+      {
+        /* coarser levels: merge the 4 children */
+        float *c[4];
+        int i;
+
+        c[0] = cdlod_height_pyramid_bounds(pyramid, lod - 1, x * 2, z * 2);
+        c[1] = cdlod_height_pyramid_bounds(pyramid, lod - 1, x * 2 + 1, z * 2);
+        c[2] = cdlod_height_pyramid_bounds(pyramid, lod - 1, x * 2, z * 2 + 1);
+        c[3] = cdlod_height_pyramid_bounds(pyramid, lod - 1, x * 2 + 1, z * 2 + 1);
+
+        min = c[0][0];
+        max = c[0][1];
+
+        for (i = 1; i < 4; ++i)
+        {
+          min = c[i][0] < min ? c[i][0] : min;
+          max = c[i][1] > max ? c[i][1] : max;
+        }
+      }
+
+      bounds[0] = min;
+      bounds[1] = max;
+    }
+  }
+}
+
+/* incrementally refit all nodes overlapping the world space rectangle after the
+ * terrain changed there
+ */
+CDLOD_API CDLOD_INLINE void cdlod_height_pyramid_refit(
+    cdlod_height_pyramid *pyramid, cdlod_height_source *height,
+    float min_x, float min_z, float max_x, float max_z)
+{
+  float size = pyramid->patch_size / (float)(1 << (pyramid->lod_count - 1));
+  float ox = (float)pyramid->origin_x * pyramid->patch_size;
+  float oz = (float)pyramid->origin_z * pyramid->patch_size;
+  int width = pyramid->level_width[0];
+  int depth = pyramid->roots_z << (pyramid->lod_count - 1);
+  float fx0 = (min_x - ox) / size;
+  float fz0 = (min_z - oz) / size;
+  int x0, z0, x1, z1;
+  int lod;
+
+  /* nodes touching the rectangle (including shared borders): from the node
+   * ending at min (ceil(min) - 1) to the node starting at max (floor(max))
+   */
+  x0 = (int)fx0;
+  z0 = (int)fz0;
+  x0 = (float)x0 < fx0 ? x0 : x0 - 1;
+  z0 = (float)z0 < fz0 ? z0 : z0 - 1;
+  x1 = (int)((max_x - ox) / size + 1.0f) - 1;
+  z1 = (int)((max_z - oz) / size + 1.0f) - 1;
+
+  x0 = x0 < 0 ? 0 : x0;
+  z0 = z0 < 0 ? 0 : z0;
+  x1 = x1 >= width ? width - 1 : x1;
+  z1 = z1 >= depth ? depth - 1 : z1;
+
+  if (x0 > x1 || z0 > z1)
+  {
+    return;
+  }
+
+  for (lod = 0; lod < pyramid->lod_count; ++lod)
+  {
+    cdlod_height_pyramid_fit_level(pyramid, height, lod, x0, z0, x1, z1);
+
+    x0 >>= 1;
+    z0 >>= 1;
+    x1 >>= 1;
+    z1 >>= 1;
+  }
+}
+
+/* recompute all levels of the given root range (inclusive, relative to the origin) */
+CDLOD_API CDLOD_INLINE void cdlod_height_pyramid_fit_roots(
+    cdlod_height_pyramid *pyramid, cdlod_height_source *height,
+    int x0, int z0, int x1, int z1)
+{
+  int lod;
+
+  for (lod = 0; lod < pyramid->lod_count; ++lod)
+  {
+    int nodes_per_root = 1 << (pyramid->lod_count - 1 - lod);
+
+    cdlod_height_pyramid_fit_level(pyramid, height, lod,
+                                   x0 * nodes_per_root, z0 * nodes_per_root,
+                                   (x1 + 1) * nodes_per_root - 1,
+                                   (z1 + 1) * nodes_per_root - 1);
+  }
+}
+
+/* build the complete pyramid (once per heightfield) */
+CDLOD_API CDLOD_INLINE void cdlod_height_pyramid_build(cdlod_height_pyramid *pyramid, cdlod_height_source *height)
+{
+  cdlod_height_pyramid_fit_roots(pyramid, height, 0, 0, pyramid->roots_x - 1, pyramid->roots_z - 1);
+}
+
+/* move the covered area to a new origin (in root patch coordinates) like a
+ * clipmap. the roots are a ring buffer, so only the rows and columns of roots
+ * that entered the area are fitted, roots that stay keep their bounds.
+ * returns the number of refitted roots.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_height_pyramid_scroll(
+    cdlod_height_pyramid *pyramid, cdlod_height_source *height,
+    int origin_x, int origin_z)
+{
+  int dx = origin_x - pyramid->origin_x;
+  int dz = origin_z - pyramid->origin_z;
+  int roots_x = pyramid->roots_x;
+  int roots_z = pyramid->roots_z;
+  int x0, x1, z0, z1;
+
+  if (dx == 0 && dz == 0)
+  {
+    return 0;
+  }
+
+  pyramid->origin_x = origin_x;
+  pyramid->origin_z = origin_z;
+
+  /* moved further than the covered area: everything is new */
+  if (dx <= -roots_x || dx >= roots_x || dz <= -roots_z || dz >= roots_z)
+  {
+    pyramid->wrap_x = 0;
+    pyramid->wrap_z = 0;
+    cdlod_height_pyramid_build(pyramid, height);
+    return roots_x * roots_z;
+  }
+
+  pyramid->wrap_x = ((pyramid->wrap_x + dx) % roots_x + roots_x) % roots_x;
+  pyramid->wrap_z = ((pyramid->wrap_z + dz) % roots_z + roots_z) % roots_z;
+
+  /* entered columns (all rows) */
+  x0 = dx > 0 ? roots_x - dx : 0;
+  x1 = dx > 0 ? roots_x - 1 : -dx - 1;
+
+  if (dx != 0)
+  {
+    cdlod_height_pyramid_fit_roots(pyramid, height, x0, 0, x1, roots_z - 1);
+  }
+
+  /* entered rows (without the columns fitted above) */
+  z0 = dz > 0 ? roots_z - dz : 0;
+  z1 = dz > 0 ? roots_z - 1 : -dz - 1;
+
+  if (dz != 0)
+  {
+    int rx0 = dx > 0 ? 0 : (dx < 0 ? -dx : 0);
+    int rx1 = dx > 0 ? roots_x - dx - 1 : roots_x - 1;
+
+    if (rx0 <= rx1)
+    {
+      cdlod_height_pyramid_fit_roots(pyramid, height, rx0, z0, rx1, z1);
+    }
+  }
+
+  return (dx < 0 ? -dx : dx) * roots_z + (dz < 0 ? -dz : dz) * (roots_x - (dx < 0 ? -dx : dx));
+}
+
+/* keep the pyramid centered on a root grid center (e.g. frame.grid_center_x/z),
+ * scrolling as needed. returns the number of refitted roots.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_height_pyramid_follow(
+    cdlod_height_pyramid *pyramid, cdlod_height_source *height,
+    int grid_center_x, int grid_center_z)
+{
+  return cdlod_height_pyramid_scroll(pyramid, height,
+                                     grid_center_x - pyramid->roots_x / 2,
+                                     grid_center_z - pyramid->roots_z / 2);
+}
+
+/* height bounds of the node of the given lod containing (x, z).
+ * returns 0 if the position is not covered by the pyramid.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_height_pyramid_query(
+    cdlod_height_pyramid *pyramid, int lod, float x, float z,
+    float *height_min, float *height_max)
+{
+  float size, fx, fz;
+  int nodes_per_root, ix, iz;
+  float *bounds;
+
+  if (lod < 0 || lod >= pyramid->lod_count)
+  {
+    return 0;
+  }
+
+  nodes_per_root = 1 << (pyramid->lod_count - 1 - lod);
+  size = pyramid->patch_size / (float)nodes_per_root;
+  fx = (x - (float)pyramid->origin_x * pyramid->patch_size) / size;
+  fz = (z - (float)pyramid->origin_z * pyramid->patch_size) / size;
+
+  if (fx < 0.0f || fz < 0.0f)
+  {
+    return 0;
+  }
+
+  ix = (int)fx;
+  iz = (int)fz;
+
+  if (ix >= pyramid->roots_x * nodes_per_root || iz >= pyramid->roots_z * nodes_per_root)
+  {
+    return 0;
+  }
+
+  bounds = cdlod_height_pyramid_bounds(pyramid, lod, ix, iz);
+  *height_min = bounds[0];
+  *height_max = bounds[1];
+
+  return 1;
+}
+
+/* largest height range of the nodes of a pyramid level */
+CDLOD_API CDLOD_INLINE float cdlod_height_pyramid_level_error(cdlod_height_pyramid *pyramid, int lod)
+{
+  int nodes_per_root = 1 << (pyramid->lod_count - 1 - lod);
+  int count = pyramid->level_width[lod] * pyramid->roots_z * nodes_per_root;
+  float *bounds = pyramid->data + pyramid->level_offset[lod];
+  float error = 0.0f;
+  int i;
+
+  for (i = 0; i < count; ++i)
+  {
+    float range = bounds[i * 2 + 1] - bounds[i * 2];
+    error = range > error ? range : error;
+  }
+
+  return error;
+}
+
+/* integer identity of a node: its lower corner in units of its size and its lod */
+typedef struct cdlod_node_key
+{
+  int x, z;
+  int lod;
+
+} cdlod_node_key;
+
+CDLOD_API CDLOD_INLINE cdlod_node_key cdlod_node_key_of(cdlod_node *node)
+{
+  cdlod_node_key key;
+  float fx = node->x / node->size - 0.5f;
+  float fz = node->z / node->size - 0.5f;
+
+  /* round to nearest, corners are whole multiples of the node size */
+  key.x = fx < 0.0f ? -(int)(0.5f - fx) : (int)(fx + 0.5f);
+  key.z = fz < 0.0f ? -(int)(0.5f - fz) : (int)(fz + 0.5f);
+  key.lod = node->lod;
+
+  return key;
+}
+
+CDLOD_API CDLOD_INLINE unsigned int cdlod_node_key_hash(cdlod_node_key key)
+{
+  return ((unsigned int)key.x * 73856093u) ^ ((unsigned int)key.z * 19349663u) ^ ((unsigned int)key.lod * 83492791u);
+}
+
+/* hash table size (power of two) for up to capacity node keys */
+CDLOD_API CDLOD_INLINE int cdlod_node_table_size(int capacity)
+{
+  int table_size = 16;
+
+  while (table_size < capacity * 2)
+  {
+    table_size *= 2;
+  }
+
+  return table_size;
+}
+
+/* remove entry index of a linear probing table of node keys (entries are
+ * slot + 1, 0 = empty, keys holds 3 ints per slot). later entries of the probe
+ * sequence shift back into the hole, so no tombstones or rebuilds are needed.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_node_table_remove(int *table, int table_size, const int *keys, int index)
+{
+  unsigned int mask = (unsigned int)table_size - 1u;
+  unsigned int i = (unsigned int)index;
+  unsigned int j = i;
+
+  table[i] = 0;
+
+  for (;;)
+  {
+    cdlod_node_key key;
+    unsigned int home;
+    const int *k;
+
+    j = (j + 1u) & mask;
+
+    if (table[j] == 0)
+    {
+      return;
+    }
+
+    k = &keys[(table[j] - 1) * 3];
+    key.x = k[0];
+    key.z = k[1];
+    key.lod = k[2];
+    home = cdlod_node_key_hash(key) & mask;
+
+    /* move the entry into the hole if its home is not between hole and entry */
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      table[i] = table[j];
+      table[j] = 0;
+      i = j;
+    }
+  }
+}
+
+/* LRU cache of generated patches in caller memory (see cdlod_patch_cache_init).
+ * the cached geometry is only valid for the height source and the geometry
+ * settings of the frame it was created for, call cdlod_patch_cache_clear()
+ * when they change.
+ */
+typedef struct cdlod_patch_cache
+{
+  int capacity;       /* number of cached patches */
+  int table_size;     /* hash table entries (power of two) */
+  int patch_vertices; /* floats per cached patch */
+  int patch_indices;  /* indices per patch (one shared template) */
+
+  float *vertices;    /* [capacity * patch_vertices] */
+  int *indices;       /* [patch_indices] template starting at vertex 0 */
+  int *keys;          /* [capacity * 3] node key of every entry */
+  int *prev;          /* [capacity] towards the most recently used entry, -1 = none */
+  int *next;          /* [capacity] towards the least recently used entry, -1 = none */
+  int *table;         /* [table_size] entry + 1, 0 = empty */
+
+  int count;          /* entries in use */
+  int head;           /* most recently used entry, -1 = empty */
+  int tail;           /* least recently used entry, -1 = empty */
+  int has_indices;    /* index template recorded */
+
+  int hits;           /* patches copied from the cache */
+  int misses;         /* patches generated (and inserted) */
+
+} cdlod_patch_cache;
+
+/* kept selection of one root of a cdlod_root_grid */
+typedef struct cdlod_root_slot
+{
+  int cell_x, cell_z; /* root patch of the selection */
+  int count;          /* selected nodes, -1 = empty */
+
+  float camera_x, camera_y, camera_z; /* camera of the traversal */
+  float slack;                        /* camera movement that keeps every leaf test of the root */
+
+} cdlod_root_slot;
+
+/* selections of the grid roots of previous frames in caller memory (see
+ * cdlod_root_grid_init). the slots are a ring buffer over root patches like a
+ * clipmap, a root keeps its slot while it stays in the grid. a root is only
+ * traversed again when it entered the grid or the camera moved far enough to
+ * change one of its leaf tests. the selections are only valid for the height
+ * source they were made with, call cdlod_root_grid_clear() when it changes.
+ * changes of the leaf test (lod_count, lod_ranges, pixel_error, the lod
+ * distances of cdlod_frame_set_screen_error, morphing) drop them by themselves.
+ */
+typedef struct cdlod_root_grid
+{
+  int width;              /* slots per side (2 * grid_radius + 1) */
+  int nodes_per_root;     /* kept nodes per root, larger selections are traversed every frame */
+  cdlod_root_slot *slots; /* [width * width] */
+  cdlod_node *nodes;      /* [width * width * nodes_per_root] */
+
+  /* leaf test the kept selections were made with (see cdlod_root_grid_begin) */
+  int lod_count;                       /* 0 = none */
+  int screen_error;                    /* selected by pixel_error */
+  int morphs;                          /* selected by the box distance */
+  float patch_size;                    /* root patch size */
+  float leaf_distance[CDLOD_MAX_LODS]; /* squared leaf distance per lod */
+
+  int traversed; /* roots traversed by the last frame */
+  int reused;    /* roots reused by the last frame */
+
+} cdlod_root_grid;
+
+/* how cracks between grid patches of different lods are hidden */
+typedef enum cdlod_seam_mode
+{
+  CDLOD_SEAM_SKIRTS = 0, /* every patch gets a skirt ring */
+  CDLOD_SEAM_STITCH = 1  /* no skirts, edges bordering a coarser node are stitched (grid patches only) */
+
+} cdlod_seam_mode;
+
+/* per frame selection state shared by the traversal of all grid roots */
+typedef struct cdlod_frame
+{
+  float camera_x, camera_y, camera_z;
+  cdlod_height_source height; /* set height.batch to sample in batches or height.heightmap */
+
+  float patch_size;
+  int lod_count;
+  float lod_ranges[CDLOD_MAX_LODS];
+  float lod_ranges_sq[CDLOD_MAX_LODS];
+  float lod_max_size[CDLOD_MAX_LODS];     /* largest node size selected at a lod */
+  float lod_leaf_dist_sq[CDLOD_MAX_LODS]; /* nodes of a lod are selected beyond this squared distance */
+
+  int grid_radius;
+  int grid_center_x, grid_center_z;
+
+  /* world position of the frame origin in root patches (origin * patch_size,
+   * see cdlod_frame_init_world). camera, nodes and vertices are relative to it.
+   */
+  int origin_x, origin_z;
+
+  /* geometry output (only used when vertices/indices are requested) */
+  float skirt_depth;
+  int patch_resolution;        /* < 2 = single quad patches, otherwise shared vertex grid */
+  cdlod_morph_mode morph_mode; /* geomorphing of grid patches (single quads never morph) */
+  cdlod_seam_mode seam_mode;   /* skirts or stitched seams (single quads always use skirts) */
+
+  /* view frustum culling (see cdlod_frame_set_frustum) */
+  int frustum_culling;
+  float frustum_planes[6 * 4];
+  float height_min, height_max; /* vertical node bounds used for culling */
+
+  /* screen space error lod selection (see cdlod_frame_set_screen_error),
+   * pixel_error <= 0 selects lods by the lod_ranges
+   */
+  float pixel_error;
+  float screen_scale;                        /* viewport_height / (2 * tan(fov_y / 2)) */
+  float lod_screen_distance[CDLOD_MAX_LODS]; /* nodes of a lod are selected beyond this distance */
+
+  /* optional per node height bounds (0 = sample the height function at the
+   * node center). used for lod distances and culling of covered nodes.
+   */
+  cdlod_height_pyramid *height_pyramid;
+
+  /* optional cache of generated patches (not thread safe, do not share it
+   * between jobs or frames running concurrently)
+   */
+  cdlod_patch_cache *patch_cache;
+
+  /* optional per lod output ranges (lod_count entries, 0 = patches of all
+   * lods interleaved). filled by cdlod_frame_traverse() and
+   * cdlod_frame_traverse_levels(), which group the output by lod.
+   */
+  cdlod_lod_range *lod_output;
+
+  /* optional selections of the previous frames, roots whose leaf tests can not
+   * have changed are not traversed again (see cdlod_root_grid). stitched seams
+   * of reused nodes are classified again every frame.
+   */
+  cdlod_root_grid *root_grid;
+
+} cdlod_frame;
+
+/* center of the root grid in patch coords, shifted towards the view direction */
+CDLOD_API CDLOD_INLINE void cdlod_grid_center(
+    float camera_x, float camera_z,
+    float forward_x, float forward_z,
+    float patch_size, int grid_radius,
+    int *grid_center_x, int *grid_center_z)
+{
+  float fx = forward_x;
+  float fz = forward_z;
+  float len;
+  float offset_x, offset_z;
+
+  /* normalize forward vector (XZ only) */
+  len = (float)(fx * fx + fz * fz);
+
+  if (len > 0.0001f)
+  {
+    len = 1.0f / cdlod_sqrtf(len);
+    fx *= len;
+    fz *= len;
+  }
+  else
+  {
+    fx = 0.0f;
+    fz = 1.0f; /* default forward = +Z */
+  }
+
+  /* compute forward shift in patch units */
+  offset_x = fx * (float)(grid_radius - 1);
+  offset_z = fz * (float)(grid_radius - 1);
+
+  /* find grid center in patch coords */
+  *grid_center_x = (int)(camera_x / patch_size + offset_x);
+  *grid_center_z = (int)(camera_z / patch_size + offset_z);
+}
+
+CDLOD_API CDLOD_INLINE void cdlod_frame_init(
+    cdlod_frame *frame,
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z,
+    cdlod_height_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius)
+{
+  int i;
+
+  frame->camera_x = camera_x;
+  frame->camera_y = camera_y;
+  frame->camera_z = camera_z;
+  frame->height.function = height;
+  frame->height.batch = 0;
+  frame->height.heightmap = 0;
+  frame->height.world = 0;
+  frame->height.origin_x = 0.0;
+  frame->height.origin_z = 0.0;
+  frame->origin_x = 0;
+  frame->origin_z = 0;
+  frame->patch_size = patch_size;
+  frame->lod_count = lod_count;
+  frame->grid_radius = grid_radius;
+  frame->skirt_depth = 0.0f;
+  frame->patch_resolution = 0;
+  frame->morph_mode = CDLOD_MORPH_NONE;
+  frame->seam_mode = CDLOD_SEAM_SKIRTS;
+  frame->frustum_culling = 0;
+  frame->pixel_error = 0.0f;
+  frame->screen_scale = 0.0f;
+  frame->height_min = 0.0f;
+  frame->height_max = 0.0f;
+  frame->height_pyramid = 0;
+  frame->patch_cache = 0;
+  frame->lod_output = 0;
+  frame->root_grid = 0;
+
+  /* pre-cache lod_ranges squared assuming lod_count <= CDLOD_MAX_LODS */
+  for (i = 0; i < lod_count; ++i)
+  {
+    frame->lod_ranges[i] = lod_ranges[i];
+    frame->lod_ranges_sq[i] = lod_ranges[i] * lod_ranges[i];
+  }
+
+  /* per lod tables of the leaf test: the selected lod at a distance is the
+   * number of leading ranges exceeded, and a node of lod l is selected once
+   * that lod reaches l (its size fits the maximum size of the selected lod)
+   */
+  for (i = 0; i < lod_count; ++i)
+  {
+    int j;
+
+    frame->lod_max_size[i] = patch_size;
+
+    for (j = lod_count - 1; j > i; --j)
+    {
+      frame->lod_max_size[i] *= 0.5f; /* halve per step above current */
+    }
+
+    frame->lod_screen_distance[i] = 0.0f;
+    frame->lod_leaf_dist_sq[i] = i == 0 ? -1.0f : frame->lod_leaf_dist_sq[i - 1];
+
+    if (i > 0 && frame->lod_ranges_sq[i] > frame->lod_leaf_dist_sq[i])
+    {
+      frame->lod_leaf_dist_sq[i] = frame->lod_ranges_sq[i];
+    }
+  }
+
+  cdlod_grid_center(camera_x, camera_z, forward_x, forward_z,
+                    patch_size, grid_radius,
+                    &frame->grid_center_x, &frame->grid_center_z);
+}
+
+/* root patch containing the world coordinate x (floor(x / patch_size)) */
+CDLOD_API CDLOD_INLINE int cdlod_world_cell(double x, float patch_size)
+{
+  double f = x / (double)patch_size;
+  int i = (int)f;
+
+  return (double)i > f ? i - 1 : i;
+}
+
+/* floating origin for large worlds: moves the origin (in root patches) to the
+ * root patch of the camera once the camera is more than max_patches root
+ * patches away from it. returns 1 if the origin moved, everything kept in frame
+ * coordinates (patch cache, height pyramid, root grid, selection) has to be
+ * reset then.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_world_rebase(
+    int *origin_x, int *origin_z,
+    double camera_x, double camera_z,
+    float patch_size, int max_patches)
+{
+  int cell_x = cdlod_world_cell(camera_x, patch_size);
+  int cell_z = cdlod_world_cell(camera_z, patch_size);
+  int dx = cell_x - *origin_x;
+  int dz = cell_z - *origin_z;
+
+  if (dx >= -max_patches && dx <= max_patches && dz >= -max_patches && dz <= max_patches)
+  {
+    return 0;
+  }
+
+  *origin_x = cell_x;
+  *origin_z = cell_z;
+
+  return 1;
+}
+
+/* cdlod_frame_init() for large worlds: the world camera position is given in
+ * double precision and the frame works relative to the world position
+ * (origin_x * patch_size, origin_z * patch_size), e.g. from cdlod_world_rebase().
+ * selection runs on small float coordinates and all emitted nodes and
+ * vertices are relative to the origin, so they keep full float precision
+ * (render them with a view matrix translated by the camera position relative
+ * to the origin). height is called with world positions in double precision.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_init_world(
+    cdlod_frame *frame,
+    double camera_x, double camera_y, double camera_z,
+    float forward_x, float forward_z,
+    int origin_x, int origin_z,
+    cdlod_height_world_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius)
+{
+  double world_x = (double)origin_x * (double)patch_size;
+  double world_z = (double)origin_z * (double)patch_size;
+
+  cdlod_frame_init(frame,
+                   (float)(camera_x - world_x), (float)camera_y, (float)(camera_z - world_z),
+                   forward_x, forward_z,
+                   0, patch_size,
+                   lod_count, lod_ranges,
+                   grid_radius);
+
+  frame->origin_x = origin_x;
+  frame->origin_z = origin_z;
+  frame->height.world = height;
+  frame->height.origin_x = world_x;
+  frame->height.origin_z = world_z;
+}
+
+/* world position of a position relative to the frame origin */
+CDLOD_API CDLOD_INLINE void cdlod_frame_world_position(
+    cdlod_frame *frame, float x, float z,
+    double *world_x, double *world_z)
+{
+  *world_x = (double)frame->origin_x * (double)frame->patch_size + (double)x;
+  *world_z = (double)frame->origin_z * (double)frame->patch_size + (double)z;
+}
+
+/* enable view frustum culling for the traversal. planes are 6 * (a, b, c, d)
+ * (see cdlod_frustum_from_matrix). height_min/height_max bound the terrain
+ * height and form the vertical extent of every node's bounding box.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_set_frustum(
+    cdlod_frame *frame, float *frustum_planes,
+    float height_min, float height_max)
+{
+  int i;
+
+  for (i = 0; i < 6 * 4; ++i)
+  {
+    frame->frustum_planes[i] = frustum_planes[i];
+  }
+
+  frame->frustum_culling = 1;
+  frame->height_min = height_min;
+  frame->height_max = height_max;
+}
+
+/* index of the cell of the given size containing x (floor(x / size)) */
+CDLOD_API CDLOD_INLINE int cdlod_cell_index(float x, float size)
+{
+  float f = x / size;
+  int i = (int)f;
+
+  return (float)i > f ? i - 1 : i;
+}
+
+/* select lods by projected geometric error instead of the lod ranges: nodes of
+ * a lod are selected once the error bound of the lod projects to at most
+ * pixel_error pixels at the distance of their bounding box. the bound is the
+ * largest height range of the level in the height pyramid if it covers the
+ * root grid, otherwise the vertex spacing of the patches of the lod. fov_y is
+ * the vertical field of view in radians. the same pixel_error keeps triangle
+ * counts stable across viewport sizes and can be changed every frame to trade
+ * quality for budget.
+ *
+ * one distance per lod gives neighbouring nodes of a lod the same morph range,
+ * and every distance is kept at least one (parent) node box diagonal beyond
+ * the previous one, so neighbouring nodes differ by at most one lod. attach
+ * the height pyramid first and call this again after it changed or moved.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_set_screen_error(
+    cdlod_frame *frame, float fov_y, float viewport_height, float pixel_error)
+{
+  cdlod_height_pyramid *pyramid = frame->height_pyramid;
+  float spacing = (float)(frame->patch_resolution >= 2 ? frame->patch_resolution - 1 : 1);
+  float distance = 0.0f;
+  int covered = 0;
+  int lod;
+
+  frame->pixel_error = pixel_error;
+  frame->screen_scale = viewport_height / (2.0f * cdlod_tanf(fov_y * 0.5f));
+
+  if (pyramid && pyramid->lod_count == frame->lod_count)
+  {
+    covered = frame->grid_center_x - frame->grid_radius >= pyramid->origin_x &&
+              frame->grid_center_z - frame->grid_radius >= pyramid->origin_z &&
+              frame->grid_center_x + frame->grid_radius < pyramid->origin_x + pyramid->roots_x &&
+              frame->grid_center_z + frame->grid_radius < pyramid->origin_z + pyramid->roots_z;
+  }
+
+  for (lod = 0; lod < frame->lod_count; ++lod)
+  {
+    float size = frame->lod_max_size[lod];
+    float error = covered ? cdlod_height_pyramid_level_error(pyramid, lod) : size / spacing;
+    float lod_distance = pixel_error > 0.0f ? error * frame->screen_scale / pixel_error : 0.0f;
+
+    /* nodes of the previous lod can only be selected inside of this distance */
+    distance = lod_distance > distance ? lod_distance : distance;
+    frame->lod_screen_distance[lod] = distance;
+
+    if (lod > 0 && distance > 0.0f)
+    {
+      distance += cdlod_sqrtf(2.0f * size * size + error * error);
+    }
+  }
+}
+
+/* fill the descriptor of a selected node */
+CDLOD_API CDLOD_INLINE void cdlod_frame_node(cdlod_frame *frame, cdlod_quadtree_node *node, cdlod_node *out)
+{
+  int lod = node->lod;
+
+  out->x = node->x;
+  out->z = node->z;
+  out->size = node->size;
+  out->lod = lod;
+  out->seams = 0;
+
+  /* screen space error: morph towards the parent until the distance at which
+   * the parent lod is selected
+   */
+  if (frame->pixel_error > 0.0f && lod + 1 < frame->lod_count)
+  {
+    float range_start = frame->lod_screen_distance[lod];
+    float range_end = frame->lod_screen_distance[lod + 1];
+
+    out->morph_end = range_end;
+    out->morph_start = range_start + (range_end - range_start) * CDLOD_MORPH_START_RATIO;
+  }
+  else if (lod + 1 < frame->lod_count)
+  {
+    float range_start = frame->lod_ranges[lod];
+    float range_end = frame->lod_ranges[lod + 1];
+
+    out->morph_end = range_end;
+    out->morph_start = range_start + (range_end - range_start) * CDLOD_MORPH_START_RATIO;
+  }
+  else
+  {
+    /* coarsest lod has nothing to morph into */
+    out->morph_start = CDLOD_MORPH_DISABLED;
+    out->morph_end = CDLOD_MORPH_DISABLED * 2.0f;
+  }
+}
+
+/* returns 1 if frustum culling is enabled and the node bounds are outside.
+ * bounds come from the height pyramid if the node is covered by it (use_pyramid)
+ * or from the frame height bounds.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_culled(cdlod_frame *frame, cdlod_quadtree_node *node, int use_pyramid)
+{
+  float half, node_min, node_max;
+
+  if (!frame->frustum_culling)
+  {
+    return 0;
+  }
+
+  if (!use_pyramid ||
+      !cdlod_height_pyramid_query(frame->height_pyramid, node->lod, node->x, node->z, &node_min, &node_max))
+  {
+    node_min = frame->height_min;
+    node_max = frame->height_max;
+  }
+
+  half = node->size * 0.5f;
+
+  return cdlod_frustum_cull_box(frame->frustum_planes,
+                                node->x - half, node_min, node->z - half,
+                                node->x + half, node_max, node->z + half);
+}
+
+/* floats per vertex of the emitted geometry */
+CDLOD_API CDLOD_INLINE int cdlod_frame_vertex_stride(cdlod_frame *frame)
+{
+  return (frame->patch_resolution >= 2 && frame->morph_mode == CDLOD_MORPH_FACTOR) ? 4 : 3;
+}
+
+/* geometry size of every emitted patch (vertices in floats). stitched patches
+ * (CDLOD_SEAM_STITCH) use at most patch_indices.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_patch_size(cdlod_frame *frame, int *patch_vertices, int *patch_indices)
+{
+  if (frame->patch_resolution >= 2)
+  {
+    int stitched = frame->seam_mode == CDLOD_SEAM_STITCH;
+
+    *patch_vertices = cdlod_grid_patch_vertex_count_seams(frame->patch_resolution, stitched) * cdlod_frame_vertex_stride(frame);
+    *patch_indices = cdlod_grid_patch_index_count_seams(frame->patch_resolution, stitched);
+  }
+  else
+  {
+    *patch_vertices = 12 * 3;
+    *patch_indices = 6 + 4 * 6;
+  }
+}
+
+/* squared distance from the camera to the node bounding box. the distance to
+ * the box (instead of the center) ensures that a node is only kept when all
+ * of it lies beyond its lod range, which is what lets the morph factor reach
+ * 1 on every border shared with a coarser node.
+ */
+CDLOD_API CDLOD_INLINE float cdlod_node_distance_sq(
+    cdlod_quadtree_node *node, float node_min, float node_max,
+    float camera_x, float camera_y, float camera_z)
+{
+  float half = node->size * 0.5f;
+  float dx, dy, dz;
+
+  dx = camera_x - node->x;
+  dx = dx < 0.0f ? -dx : dx;
+  dx = dx > half ? dx - half : 0.0f;
+  dz = camera_z - node->z;
+  dz = dz < 0.0f ? -dz : dz;
+  dz = dz > half ? dz - half : 0.0f;
+  dy = camera_y < node_min ? node_min - camera_y : (camera_y > node_max ? camera_y - node_max : 0.0f);
+
+  return dx * dx + dy * dy + dz * dz;
+}
+
+/* returns 1 if the emitted patches morph (grid patches with a morph mode) */
+CDLOD_API CDLOD_INLINE int cdlod_frame_morphs(cdlod_frame *frame)
+{
+  return frame->patch_resolution >= 2 && frame->morph_mode != CDLOD_MORPH_NONE;
+}
+
+/* squared lod distance of a node. morphing patches use the box distance (see
+ * cdlod_node_distance_sq), patches that do not morph (single quads of cdlod(),
+ * unmorphed grids) keep the distance to the node center, which selects fewer
+ * nodes.
+ */
+CDLOD_API CDLOD_INLINE float cdlod_frame_distance_sq(
+    cdlod_frame *frame, cdlod_quadtree_node *node, float node_min, float node_max,
+    float camera_x, float camera_y, float camera_z)
+{
+  cdlod_quadtree_node center;
+
+  if (cdlod_frame_morphs(frame))
+  {
+    return cdlod_node_distance_sq(node, node_min, node_max, camera_x, camera_y, camera_z);
+  }
+
+  center = *node;
+  center.size = 0.0f;
+
+  return cdlod_node_distance_sq(&center, node_min, node_max, camera_x, camera_y, camera_z);
+}
+
+/* returns 1 if a node is selected at the squared distance dist (leaf) and 0
+ * if it has to be subdivided
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_leaf(cdlod_frame *frame, cdlod_quadtree_node *node, float dist)
+{
+  int lod;
+
+  /* screen space error: error * screen_scale / distance <= pixel_error */
+  if (frame->pixel_error > 0.0f)
+  {
+    float leaf_distance = frame->lod_screen_distance[node->lod];
+
+    return node->lod <= 0 || dist >= leaf_distance * leaf_distance;
+  }
+
+  /* LOD selection: 0 = highest detail */
+  lod = 0;
+  while (lod + 1 < frame->lod_count && dist > frame->lod_ranges_sq[lod + 1])
+  {
+    lod++;
+  }
+
+  return node->size <= frame->lod_max_size[lod];
+}
+
+/* distance the camera can move without changing cdlod_frame_leaf() of a node
+ * at the squared distance dist. the box distance changes at most as much as
+ * the camera moves, a small margin keeps float rounding on the same side.
+ */
+CDLOD_API CDLOD_INLINE float cdlod_frame_leaf_slack(cdlod_frame *frame, cdlod_quadtree_node *node, float dist)
+{
+  float threshold_sq, distance, threshold, slack;
+
+  if (node->lod <= 0)
+  {
+    return 1.0e30f; /* always a leaf */
+  }
+
+  if (frame->pixel_error > 0.0f)
+  {
+    threshold = frame->lod_screen_distance[node->lod];
+    threshold_sq = threshold * threshold;
+  }
+  else
+  {
+    threshold_sq = frame->lod_leaf_dist_sq[node->lod];
+  }
+
+  distance = dist > 0.0f ? cdlod_sqrtf(dist) : 0.0f;
+  threshold = threshold_sq > 0.0f ? cdlod_sqrtf(threshold_sq) : 0.0f;
+  slack = distance > threshold ? distance - threshold : threshold - distance;
+
+  return slack - (distance + threshold) * 0.0001f;
+}
+
+/* returns 1 if the node of the given lod at (x, z) would be selected by the
+ * traversal once reached (same height bounds and leaf test)
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_selects(
+    cdlod_frame *frame, cdlod_height_source *height,
+    float x, float z, int lod,
+    float camera_x, float camera_y, float camera_z)
+{
+  cdlod_quadtree_node node;
+  float node_min, node_max;
+
+  node.x = x;
+  node.z = z;
+  node.size = frame->lod_max_size[lod];
+  node.lod = lod;
+
+  if (!frame->height_pyramid ||
+      !cdlod_height_pyramid_query(frame->height_pyramid, lod, x, z, &node_min, &node_max))
+  {
+    cdlod_height_source_sample(height, &x, &z, &node_min, 1);
+    node_max = node_min;
+  }
+
+  return cdlod_frame_leaf(frame, &node, cdlod_frame_distance_sq(frame, &node, node_min, node_max, camera_x, camera_y, camera_z));
+}
+
+/* cdlod_node.seams of a selected node in CDLOD_SEAM_STITCH mode (0 otherwise).
+ * for every edge the neighbour area is followed down from the first ancestor
+ * it shares with the node: the first ancestor of the neighbour that the
+ * traversal selects is the coarser node across the edge. neighbours outside of
+ * the root grid of the traversal (grid_center_x/z, grid_radius) count as same
+ * lod. costs up to lod_count height samples per edge without a height pyramid.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_seams(
+    cdlod_frame *frame, cdlod_quadtree_node *node, cdlod_height_source *height,
+    int grid_center_x, int grid_center_z, int grid_radius,
+    float camera_x, float camera_y, float camera_z)
+{
+  int seams = CDLOD_SEAMS_STITCHED;
+  int edge;
+
+  if (frame->seam_mode != CDLOD_SEAM_STITCH || frame->patch_resolution < 2)
+  {
+    return 0;
+  }
+
+  for (edge = 0; edge < 4; ++edge)
+  {
+    float nx = node->x + (edge == CDLOD_EDGE_LEFT ? -node->size : (edge == CDLOD_EDGE_RIGHT ? node->size : 0.0f));
+    float nz = node->z + (edge == CDLOD_EDGE_BOTTOM ? -node->size : (edge == CDLOD_EDGE_TOP ? node->size : 0.0f));
+    int root_x = cdlod_cell_index(nx, frame->patch_size) - grid_center_x;
+    int root_z = cdlod_cell_index(nz, frame->patch_size) - grid_center_z;
+    int shared = node->lod + 1;
+    int lod;
+
+    if (root_x < -grid_radius || root_x > grid_radius ||
+        root_z < -grid_radius || root_z > grid_radius)
+    {
+      continue;
+    }
+
+    /* first ancestor (subdivided) shared by the node and the neighbour area */
+    while (shared < frame->lod_count)
+    {
+      float size = frame->lod_max_size[shared];
+
+      if (cdlod_cell_index(nx, size) == cdlod_cell_index(node->x, size) &&
+          cdlod_cell_index(nz, size) == cdlod_cell_index(node->z, size))
+      {
+        break;
+      }
+
+      shared++;
+    }
+
+    for (lod = shared - 1; lod > node->lod; --lod)
+    {
+      float size = frame->lod_max_size[lod];
+      float cx = ((float)cdlod_cell_index(nx, size) + 0.5f) * size;
+      float cz = ((float)cdlod_cell_index(nz, size) + 0.5f) * size;
+
+      if (cdlod_frame_selects(frame, height, cx, cz, lod, camera_x, camera_y, camera_z))
+      {
+        seams |= (lod - node->lod) << (4 + edge * 4);
+        break;
+      }
+    }
+  }
+
+  return seams;
+}
+
+/* account for a selected node in result and write its node descriptor.
+ * returns 1 if geometry is requested and fits into the buffers.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_reserve(
+    cdlod_node *selected,
+    int patch_vertices, int patch_indices,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count,
+    cdlod_result *result)
+{
+  int fits = 1;
+
+  result->nodes_required++;
+  result->vertices_required += patch_vertices;
+  result->indices_required += patch_indices;
+
+  if (nodes)
+  {
+    if (*nodes_count < nodes_capacity)
+    {
+      nodes[(*nodes_count)++] = *selected;
+    }
+    else
+    {
+      result->status |= CDLOD_STATUS_NODES_FULL;
+    }
+  }
+
+  if (!vertices)
+  {
+    return 0;
+  }
+
+  if (*vertices_count + patch_vertices > vertices_capacity)
+  {
+    result->status |= CDLOD_STATUS_VERTICES_FULL;
+    fits = 0;
+  }
+
+  if (*indices_count + patch_indices > indices_capacity)
+  {
+    result->status |= CDLOD_STATUS_INDICES_FULL;
+    fits = 0;
+  }
+
+  return fits;
+}
+
+/* copy an already generated patch (source_base_vertex is the vertex index the
+ * source indices start at) instead of sampling it again. morph factors are
+ * recomputed for the camera. the caller checks the capacity.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_copy_patch(
+    cdlod_frame *frame, cdlod_node *selected,
+    float camera_x, float camera_y, float camera_z,
+    const float *source_vertices, const int *source_indices, int source_base_vertex,
+    int patch_vertices, int patch_indices,
+    float *vertices, int *vertices_count,
+    int *indices, int *indices_count)
+{
+  float *v = vertices + *vertices_count;
+  int *idx = indices + *indices_count;
+  int base_offset = *vertices_count / cdlod_frame_vertex_stride(frame) - source_base_vertex;
+  int i;
+
+  for (i = 0; i < patch_vertices; ++i)
+  {
+    v[i] = source_vertices[i];
+  }
+
+  for (i = 0; i < patch_indices; ++i)
+  {
+    idx[i] = source_indices[i] + base_offset;
+  }
+
+  if (frame->patch_resolution >= 2 && frame->morph_mode == CDLOD_MORPH_FACTOR)
+  {
+    int grid_vertices = frame->patch_resolution * frame->patch_resolution;
+    int ring = (selected->seams & CDLOD_SEAMS_STITCHED) ? 0 : 4 * (frame->patch_resolution - 1);
+
+    for (i = 0; i < grid_vertices; ++i)
+    {
+      float *p = v + i * 4;
+      p[3] = cdlod_morph_factor(selected, camera_x, camera_y, camera_z, p[0], p[1], p[2]);
+    }
+
+    /* skirts share the factor of their border vertex (stitched patches have none) */
+    for (i = 0; i < ring; ++i)
+    {
+      v[(grid_vertices + i) * 4 + 3] = v[cdlod_grid_ring_vertex(frame->patch_resolution, i) * 4 + 3];
+    }
+  }
+
+  *vertices_count += patch_vertices;
+  *indices_count += patch_indices;
+}
+
+/* number of floats required for the vertices of a patch cache */
+CDLOD_API CDLOD_INLINE int cdlod_patch_cache_vertices_size(cdlod_frame *frame, int capacity)
+{
+  int patch_vertices, patch_indices;
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  return capacity * patch_vertices;
+}
+
+/* number of ints required for the data of a patch cache */
+CDLOD_API CDLOD_INLINE int cdlod_patch_cache_memory_size(cdlod_frame *frame, int capacity)
+{
+  int patch_vertices, patch_indices;
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  return patch_indices + capacity * 5 + cdlod_node_table_size(capacity);
+}
+
+/* drop all entries (e.g. after the height source changed), keeps the counters */
+CDLOD_API CDLOD_INLINE void cdlod_patch_cache_clear(cdlod_patch_cache *cache)
+{
+  int i;
+
+  cache->count = 0;
+  cache->head = -1;
+  cache->tail = -1;
+
+  for (i = 0; i < cache->table_size; ++i)
+  {
+    cache->table[i] = 0;
+  }
+}
+
+/* set up a cache for the geometry settings of frame. returns 0 if vertices or
+ * data are too small.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_patch_cache_init(
+    cdlod_patch_cache *cache, cdlod_frame *frame, int capacity,
+    float *vertices, int vertices_capacity,
+    int *data, int data_capacity)
+{
+  if (capacity < 1 ||
+      cdlod_patch_cache_vertices_size(frame, capacity) > vertices_capacity ||
+      cdlod_patch_cache_memory_size(frame, capacity) > data_capacity)
+  {
+    return 0;
+  }
+
+  cdlod_frame_patch_size(frame, &cache->patch_vertices, &cache->patch_indices);
+
+  cache->capacity = capacity;
+  cache->table_size = cdlod_node_table_size(capacity);
+  cache->vertices = vertices;
+  cache->indices = data;
+  cache->keys = cache->indices + cache->patch_indices;
+  cache->prev = cache->keys + capacity * 3;
+  cache->next = cache->prev + capacity;
+  cache->table = cache->next + capacity;
+  cache->has_indices = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+
+  cdlod_patch_cache_clear(cache);
+
+  return 1;
+}
+
+/* returns the table slot of key (empty if not present) */
+CDLOD_API CDLOD_INLINE int cdlod_patch_cache_find(cdlod_patch_cache *cache, cdlod_node_key key)
+{
+  unsigned int mask = (unsigned int)cache->table_size - 1u;
+  unsigned int i = cdlod_node_key_hash(key) & mask;
+
+  for (;;)
+  {
+    int entry = cache->table[i];
+    int *k;
+
+    if (entry == 0)
+    {
+      return (int)i;
+    }
+
+    k = &cache->keys[(entry - 1) * 3];
+
+    if (k[0] == key.x && k[1] == key.z && k[2] == key.lod)
+    {
+      return (int)i;
+    }
+
+    i = (i + 1u) & mask;
+  }
+}
+
+/* remove a table slot, later entries of the probe sequence shift back */
+CDLOD_API CDLOD_INLINE void cdlod_patch_cache_remove(cdlod_patch_cache *cache, int slot)
+{
+  cdlod_node_table_remove(cache->table, cache->table_size, cache->keys, slot);
+}
+
+CDLOD_API CDLOD_INLINE void cdlod_patch_cache_unlink(cdlod_patch_cache *cache, int entry)
+{
+  int prev = cache->prev[entry];
+  int next = cache->next[entry];
+
+  if (prev >= 0)
+  {
+    cache->next[prev] = next;
+  }
+  else
+  {
+    cache->head = next;
+  }
+
+  if (next >= 0)
+  {
+    cache->prev[next] = prev;
+  }
+  else
+  {
+    cache->tail = prev;
+  }
+}
+
+CDLOD_API CDLOD_INLINE void cdlod_patch_cache_push_front(cdlod_patch_cache *cache, int entry)
+{
+  cache->prev[entry] = -1;
+  cache->next[entry] = cache->head;
+
+  if (cache->head >= 0)
+  {
+    cache->prev[cache->head] = entry;
+  }
+  else
+  {
+    cache->tail = entry;
+  }
+
+  cache->head = entry;
+}
+
+/* generate the geometry of a selected node from the height source or copy
+ * it from the patch cache of the frame (if set)
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_generate(
+    cdlod_frame *frame, cdlod_quadtree_node *node, cdlod_node *selected,
+    cdlod_height_source *height,
+    float camera_x, float camera_y, float camera_z,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count)
+{
+  cdlod_patch_cache *cache = frame->patch_cache;
+  cdlod_node_key key;
+  int vertices_start = *vertices_count;
+  int indices_start = *indices_count;
+  int i;
+
+  /* position morphed patches depend on the camera and are never cached,
+   * neither are patches stitched to a coarser neighbour
+   */
+  if (cache && frame->patch_resolution >= 2 &&
+      (frame->morph_mode == CDLOD_MORPH_POSITION || (selected->seams >> 4) != 0))
+  {
+    cache = 0;
+  }
+
+  if (cache)
+  {
+    int entry;
+
+    key = cdlod_node_key_of(selected);
+    entry = cache->table[cdlod_patch_cache_find(cache, key)] - 1;
+
+    if (entry >= 0)
+    {
+      if (*vertices_count + cache->patch_vertices > vertices_capacity ||
+          *indices_count + cache->patch_indices > indices_capacity)
+      {
+        return;
+      }
+
+      cdlod_frame_copy_patch(frame, selected,
+                             camera_x, camera_y, camera_z,
+                             cache->vertices + entry * cache->patch_vertices, cache->indices, 0,
+                             cache->patch_vertices, cache->patch_indices,
+                             vertices, vertices_count,
+                             indices, indices_count);
+
+      cdlod_patch_cache_unlink(cache, entry);
+      cdlod_patch_cache_push_front(cache, entry);
+      cache->hits++;
+      return;
+    }
+  }
+
+  if (frame->patch_resolution >= 2)
+  {
+    cdlod_generate_grid_patch(vertices, vertices_capacity, vertices_count,
+                              indices, indices_capacity, indices_count,
+                              selected, height, frame->skirt_depth,
+                              frame->patch_resolution, frame->morph_mode,
+                              camera_x, camera_y, camera_z);
+  }
+  else
+  {
+    float half = node->size * 0.5f;
+    float xs[4], zs[4], hs[4];
+
+    xs[0] = xs[3] = node->x - half;
+    xs[1] = xs[2] = node->x + half;
+    zs[0] = zs[1] = node->z - half;
+    zs[2] = zs[3] = node->z + half;
+
+    cdlod_height_source_sample(height, xs, zs, hs, 4);
+
+    cdlod_generate_patch_sampled(vertices, vertices_capacity, vertices_count,
+                                 indices, indices_capacity, indices_count,
+                                 node, hs[0], hs[1], hs[2], hs[3],
+                                 frame->skirt_depth);
+  }
+
+  /* insert the generated patch, evicting the least recently used one */
+  if (cache && *vertices_count > vertices_start)
+  {
+    int entry;
+
+    cache->misses++;
+
+    if (cache->count < cache->capacity)
+    {
+      entry = cache->count++;
+    }
+    else
+    {
+      cdlod_node_key evicted;
+
+      entry = cache->tail;
+      evicted.x = cache->keys[entry * 3 + 0];
+      evicted.z = cache->keys[entry * 3 + 1];
+      evicted.lod = cache->keys[entry * 3 + 2];
+
+      cdlod_patch_cache_remove(cache, cdlod_patch_cache_find(cache, evicted));
+      cdlod_patch_cache_unlink(cache, entry);
+    }
+
+    for (i = 0; i < cache->patch_vertices; ++i)
+    {
+      cache->vertices[entry * cache->patch_vertices + i] = vertices[vertices_start + i];
+    }
+
+    /* indices only differ by the base vertex */
+    if (!cache->has_indices)
+    {
+      int base_vertex = vertices_start / cdlod_frame_vertex_stride(frame);
+
+      for (i = 0; i < cache->patch_indices; ++i)
+      {
+        cache->indices[i] = indices[indices_start + i] - base_vertex;
+      }
+
+      cache->has_indices = 1;
+    }
+
+    cache->keys[entry * 3 + 0] = key.x;
+    cache->keys[entry * 3 + 1] = key.z;
+    cache->keys[entry * 3 + 2] = key.lod;
+    cache->table[cdlod_patch_cache_find(cache, key)] = entry + 1;
+
+    cdlod_patch_cache_push_front(cache, entry);
+  }
+}
+
+/* select a leaf node: write its descriptor and generate its patch. with
+ * ranges (lod_count entries) nothing is written, the sizes required per lod
+ * are counted into the ranges instead.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_emit_node(
+    cdlod_frame *frame, cdlod_quadtree_node *node, cdlod_height_source *height,
+    cdlod_lod_range *ranges,
+    int patch_vertices, int patch_indices,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count,
+    cdlod_result *result)
+{
+  cdlod_node selected;
+  cdlod_lod_range *range;
+
+  cdlod_frame_node(frame, node, &selected);
+  selected.seams = cdlod_frame_seams(frame, node, height,
+                                     frame->grid_center_x, frame->grid_center_z, frame->grid_radius,
+                                     frame->camera_x, frame->camera_y, frame->camera_z);
+
+  if (!ranges)
+  {
+    if (cdlod_frame_reserve(&selected, patch_vertices, patch_indices,
+                            vertices, vertices_capacity, vertices_count,
+                            indices_capacity, indices_count,
+                            nodes, nodes_capacity, nodes_count,
+                            result))
+    {
+      cdlod_frame_generate(frame, node, &selected, height,
+                           frame->camera_x, frame->camera_y, frame->camera_z,
+                           vertices, vertices_capacity, vertices_count,
+                           indices, indices_capacity, indices_count);
+    }
+    return;
+  }
+
+  range = &ranges[node->lod];
+  cdlod_frame_reserve(&selected, patch_vertices, patch_indices,
+                      0, 0, 0, 0, 0, 0, 0, 0,
+                      result);
+  range->vertices_count += patch_vertices;
+  range->indices_count += patch_indices;
+  range->nodes_count++;
+}
+
+/* quadtree traversal */
+/* iterative quadtree traversal using manual stack
+ *
+ * selected nodes are written as geometry (if vertices is set) and/or as node
+ * descriptors (if nodes is set). unused outputs may be passed as 0. required
+ * sizes and overflows are accumulated into result. ranges (if set) counts the
+ * sizes per lod instead of writing (see cdlod_frame_emit_node). slack (if set) is
+ * lowered to the smallest cdlod_frame_leaf_slack() of all tested nodes.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_quadtree_traverse(
+    cdlod_frame *frame, cdlod_quadtree_node root, cdlod_lod_range *ranges,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count,
+    cdlod_result *result, float *slack)
+{
+  /* stack-based traversal */
+  cdlod_quadtree_node stack[64]; /* supports depth ~64, more than enough */
+  float stack_height[64];        /* node center heights (only without height bounds) */
+  int stack_size = 0;
+  int root_bounds;
+  float root_min, root_max;
+
+  /* geometry size of every emitted patch */
+  int patch_vertices, patch_indices;
+
+  /* local copies, the height callback could otherwise force reloads from frame */
+  cdlod_height_source height = frame->height;
+  float camera_x = frame->camera_x;
+  float camera_y = frame->camera_y;
+  float camera_z = frame->camera_z;
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  /* pyramids cover whole roots, so the root decides for the entire subtree
+   * whether center heights have to be sampled
+   */
+  root_bounds = frame->height_pyramid &&
+                cdlod_height_pyramid_query(frame->height_pyramid, root.lod, root.x, root.z,
+                                           &root_min, &root_max);
+
+  /* nodes are culled before they are pushed (and sampled) */
+  if (cdlod_frame_culled(frame, &root, root_bounds))
+  {
+    return;
+  }
+
+  if (!root_bounds)
+  {
+    cdlod_height_source_sample(&height, &root.x, &root.z, &stack_height[0], 1);
+  }
+
+  stack[stack_size++] = root;
+
+  while (stack_size > 0)
+  {
+    cdlod_quadtree_node node = stack[--stack_size];
+    float half = node.size * 0.5f;
+    float dist;
+    float node_min, node_max;
+    int i;
+
+    /* without height bounds the box is flat at the height of the node center */
+    if (!root_bounds ||
+        !cdlod_height_pyramid_query(frame->height_pyramid, node.lod, node.x, node.z, &node_min, &node_max))
+    {
+      node_min = node_max = stack_height[stack_size]; /* popped node */
+    }
+
+    dist = cdlod_frame_distance_sq(frame, &node, node_min, node_max, camera_x, camera_y, camera_z);
+
+    if (slack)
+    {
+      float node_slack = cdlod_frame_leaf_slack(frame, &node, dist);
+      *slack = node_slack < *slack ? node_slack : *slack;
+    }
+
+    /* leaf node: generate patch and/or node descriptor */
+    if (cdlod_frame_leaf(frame, &node, dist))
+    {
+      cdlod_frame_emit_node(frame, &node, &height, ranges, patch_vertices, patch_indices,
+                            vertices, vertices_capacity, vertices_count,
+                            indices, indices_capacity, indices_count,
+                            nodes, nodes_capacity, nodes_count,
+                            result);
+      continue;
+    }
+
+    /* subdivide into 4 children  & push the visible children on stack */
+    if (stack_size + 4 <= 64)
+    {
+      float quarter = half * 0.5f;
+      int pushed = 0;
+
+      for (i = 0; i < 4; ++i)
+      {
+        cdlod_quadtree_node *child = &stack[stack_size + pushed];
+
+        child->x = node.x + ((i == 1 || i == 2) ? quarter : -quarter);
+        child->z = node.z + ((i >= 2) ? quarter : -quarter);
+        child->size = half;
+        child->lod = node.lod - 1;
+
+        if (!cdlod_frame_culled(frame, child, root_bounds))
+        {
+          pushed++;
+        }
+      }
+
+      /* sample the child center heights in one batch */
+      if (!root_bounds && pushed > 0)
+      {
+        float xs[4], zs[4];
+
+        for (i = 0; i < pushed; ++i)
+        {
+          xs[i] = stack[stack_size + i].x;
+          zs[i] = stack[stack_size + i].z;
+        }
+
+        cdlod_height_source_sample(&height, xs, zs, &stack_height[stack_size], pushed);
+      }
+
+      stack_size += pushed;
+    }
+    else
+    {
+      result->status |= CDLOD_STATUS_STACK_FULL;
+    }
+  }
+}
+
+/* number of roots in the (2 * grid_radius + 1)^2 grid around the camera */
+CDLOD_API CDLOD_INLINE int cdlod_frame_root_count(cdlod_frame *frame)
+{
+  int width = 2 * frame->grid_radius + 1;
+  return width * width;
+}
+
+/* root node at index (column major over the grid, x outer and z inner) */
+CDLOD_API CDLOD_INLINE void cdlod_frame_root(cdlod_frame *frame, int index, cdlod_quadtree_node *root)
+{
+  int width = 2 * frame->grid_radius + 1;
+  int gx = index / width - frame->grid_radius;
+  int gz = index % width - frame->grid_radius;
+
+  root->x = (float)(frame->grid_center_x + gx) * frame->patch_size + frame->patch_size * 0.5f;
+  root->z = (float)(frame->grid_center_z + gz) * frame->patch_size + frame->patch_size * 0.5f;
+  root->size = frame->patch_size;
+  root->lod = frame->lod_count - 1;
+}
+
+/* number of slots of a root grid (and of its nodes in nodes_per_root) */
+CDLOD_API CDLOD_INLINE int cdlod_root_grid_slot_count(int grid_radius)
+{
+  int width = 2 * grid_radius + 1;
+
+  return width * width;
+}
+
+/* drop all kept selections (e.g. after the height source changed) */
+CDLOD_API CDLOD_INLINE void cdlod_root_grid_clear(cdlod_root_grid *grid)
+{
+  int i;
+
+  for (i = 0; i < grid->width * grid->width; ++i)
+  {
+    grid->slots[i].count = -1;
+  }
+
+  for (i = 0; i < CDLOD_MAX_LODS; ++i)
+  {
+    grid->leaf_distance[i] = 0.0f;
+  }
+
+  grid->lod_count = 0;
+  grid->screen_error = 0;
+  grid->morphs = 0;
+  grid->patch_size = 0.0f;
+  grid->traversed = 0;
+  grid->reused = 0;
+}
+
+/* start a frame with the grid: resets the counters and drops the kept
+ * selections if the leaf test of the frame differs from the one they were
+ * made with
+ */
+CDLOD_API CDLOD_INLINE void cdlod_root_grid_begin(cdlod_root_grid *grid, cdlod_frame *frame)
+{
+  int screen_error = frame->pixel_error > 0.0f;
+  int morphs = cdlod_frame_morphs(frame);
+  int changed = grid->lod_count != frame->lod_count || grid->screen_error != screen_error ||
+                grid->morphs != morphs || grid->patch_size != frame->patch_size;
+  float leaf_distance[CDLOD_MAX_LODS];
+  int lod;
+
+  for (lod = 0; lod < frame->lod_count; ++lod)
+  {
+    float distance = frame->lod_screen_distance[lod];
+
+    leaf_distance[lod] = screen_error ? distance * distance : frame->lod_leaf_dist_sq[lod];
+    changed |= grid->leaf_distance[lod] != leaf_distance[lod];
+  }
+
+  if (changed)
+  {
+    cdlod_root_grid_clear(grid);
+
+    grid->lod_count = frame->lod_count;
+    grid->screen_error = screen_error;
+    grid->morphs = morphs;
+    grid->patch_size = frame->patch_size;
+
+    for (lod = 0; lod < frame->lod_count; ++lod)
+    {
+      grid->leaf_distance[lod] = leaf_distance[lod];
+    }
+  }
+
+  grid->traversed = 0;
+  grid->reused = 0;
+}
+
+/* sets up a root grid for frames with the given grid_radius. nodes_per_root
+ * should hold the largest selection of a root (at most 4^(lod_count - 1)),
+ * roots selecting more nodes are traversed every frame.
+ * returns 0 if slots or nodes are too small.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_root_grid_init(
+    cdlod_root_grid *grid,
+    cdlod_root_slot *slots, int slots_capacity,
+    cdlod_node *nodes, int nodes_capacity,
+    int grid_radius, int nodes_per_root)
+{
+  int slot_count = cdlod_root_grid_slot_count(grid_radius);
+
+  if (grid_radius < 0 || nodes_per_root < 1 ||
+      slot_count > slots_capacity || slot_count * nodes_per_root > nodes_capacity)
+  {
+    return 0;
+  }
+
+  grid->width = 2 * grid_radius + 1;
+  grid->nodes_per_root = nodes_per_root;
+  grid->slots = slots;
+  grid->nodes = nodes;
+
+  cdlod_root_grid_clear(grid);
+
+  return 1;
+}
+
+/* traverse a root of the grid. with frame->root_grid the selection of the root
+ * is kept and reused as long as the camera stays within the slack of its leaf
+ * tests, so only roots that entered the grid or are close enough to the camera
+ * to change their lods are traversed. the kept selection is made without
+ * culling, reused nodes are culled one by one. a node box lies inside the box
+ * of its parent, so this selects the same nodes as culling whole subtrees.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_traverse_root(
+    cdlod_frame *frame, cdlod_quadtree_node *root, cdlod_lod_range *ranges,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count,
+    cdlod_result *result)
+{
+  cdlod_root_grid *grid = frame->root_grid;
+  cdlod_height_source height = frame->height;
+  cdlod_root_slot *slot;
+  cdlod_node *kept;
+  int width, cell_x, cell_z, slot_index;
+  int root_bounds, patch_vertices, patch_indices, i;
+  float root_min, root_max;
+  float dx, dy, dz;
+
+  if (!grid)
+  {
+    cdlod_quadtree_traverse(frame, *root, ranges,
+                            vertices, vertices_capacity, vertices_count,
+                            indices, indices_capacity, indices_count,
+                            nodes, nodes_capacity, nodes_count,
+                            result, 0);
+    return;
+  }
+
+  root_bounds = frame->height_pyramid &&
+                cdlod_height_pyramid_query(frame->height_pyramid, root->lod, root->x, root->z,
+                                           &root_min, &root_max);
+
+  if (cdlod_frame_culled(frame, root, root_bounds))
+  {
+    return;
+  }
+
+  /* ring buffer slot of the root patch */
+  width = grid->width;
+  cell_x = cdlod_cell_index(root->x, frame->patch_size);
+  cell_z = cdlod_cell_index(root->z, frame->patch_size);
+  slot_index = ((cell_x % width + width) % width) * width + (cell_z % width + width) % width;
+  slot = &grid->slots[slot_index];
+  kept = grid->nodes + slot_index * grid->nodes_per_root;
+
+  dx = frame->camera_x - slot->camera_x;
+  dy = frame->camera_y - slot->camera_y;
+  dz = frame->camera_z - slot->camera_z;
+
+  if (slot->count >= 0 && slot->cell_x == cell_x && slot->cell_z == cell_z &&
+      dx * dx + dy * dy + dz * dz < slot->slack * slot->slack)
+  {
+    grid->reused++;
+  }
+  else
+  {
+    int frustum_culling = frame->frustum_culling;
+    cdlod_result kept_result;
+    int kept_count = 0;
+    float slack = 1.0e30f;
+
+    kept_result.status = CDLOD_STATUS_OK;
+    kept_result.vertices_required = 0;
+    kept_result.indices_required = 0;
+    kept_result.nodes_required = 0;
+
+    frame->frustum_culling = 0;
+    cdlod_quadtree_traverse(frame, *root, 0,
+                            0, 0, 0,
+                            0, 0, 0,
+                            kept, grid->nodes_per_root, &kept_count,
+                            &kept_result, &slack);
+    frame->frustum_culling = frustum_culling;
+    grid->traversed++;
+
+    /* too many nodes to keep: traverse directly */
+    if (kept_result.status != CDLOD_STATUS_OK)
+    {
+      slot->count = -1;
+      cdlod_quadtree_traverse(frame, *root, ranges,
+                              vertices, vertices_capacity, vertices_count,
+                              indices, indices_capacity, indices_count,
+                              nodes, nodes_capacity, nodes_count,
+                              result, 0);
+      return;
+    }
+
+    slot->cell_x = cell_x;
+    slot->cell_z = cell_z;
+    slot->count = kept_count;
+    slot->camera_x = frame->camera_x;
+    slot->camera_y = frame->camera_y;
+    slot->camera_z = frame->camera_z;
+    slot->slack = slack;
+  }
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  for (i = 0; i < slot->count; ++i)
+  {
+    cdlod_quadtree_node node;
+
+    node.x = kept[i].x;
+    node.z = kept[i].z;
+    node.size = kept[i].size;
+    node.lod = kept[i].lod;
+
+    if (cdlod_frame_culled(frame, &node, root_bounds))
+    {
+      continue;
+    }
+
+    cdlod_frame_emit_node(frame, &node, &height, ranges, patch_vertices, patch_indices,
+                          vertices, vertices_capacity, vertices_count,
+                          indices, indices_capacity, indices_count,
+                          nodes, nodes_capacity, nodes_count,
+                          result);
+  }
+}
+
+/* group selected node descriptors by lod (lod 0 first, in place, the order
+ * within a lod is not kept) and emit their patches in that order. fills the
+ * ranges, required sizes were accounted by the selection.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_emit_lods(
+    cdlod_frame *frame, cdlod_lod_range *ranges,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_count,
+    cdlod_result *result)
+{
+  int next[CDLOD_MAX_LODS];
+  int patch_vertices, patch_indices;
+  cdlod_height_source height = frame->height;
+  int i, lod;
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    ranges[nodes[i].lod].nodes_count++;
+  }
+
+  for (lod = 0; lod < frame->lod_count; ++lod)
+  {
+    ranges[lod].nodes_offset = lod > 0 ? ranges[lod - 1].nodes_offset + ranges[lod - 1].nodes_count : 0;
+    next[lod] = ranges[lod].nodes_offset;
+  }
+
+  /* swap every node into the next free place of its lod */
+  for (lod = 0; lod < frame->lod_count; ++lod)
+  {
+    int end = ranges[lod].nodes_offset + ranges[lod].nodes_count;
+
+    while (next[lod] < end)
+    {
+      cdlod_node node = nodes[next[lod]];
+
+      if (node.lod == lod)
+      {
+        next[lod]++;
+        continue;
+      }
+
+      nodes[next[lod]] = nodes[next[node.lod]];
+      nodes[next[node.lod]++] = node;
+    }
+  }
+
+  if (!vertices)
+  {
+    return;
+  }
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  for (lod = 0; lod < frame->lod_count; ++lod)
+  {
+    ranges[lod].vertices_offset = *vertices_count;
+    ranges[lod].indices_offset = *indices_count;
+
+    for (i = ranges[lod].nodes_offset; i < ranges[lod].nodes_offset + ranges[lod].nodes_count; ++i)
+    {
+      cdlod_quadtree_node node;
+
+      if (*vertices_count + patch_vertices > vertices_capacity)
+      {
+        result->status |= CDLOD_STATUS_VERTICES_FULL;
+        continue;
+      }
+
+      if (*indices_count + patch_indices > indices_capacity)
+      {
+        result->status |= CDLOD_STATUS_INDICES_FULL;
+        continue;
+      }
+
+      node.x = nodes[i].x;
+      node.z = nodes[i].z;
+      node.size = nodes[i].size;
+      node.lod = nodes[i].lod;
+
+      cdlod_frame_generate(frame, &node, &nodes[i], &height,
+                           frame->camera_x, frame->camera_y, frame->camera_z,
+                           vertices, vertices_capacity, vertices_count,
+                           indices, indices_capacity, indices_count);
+    }
+
+    ranges[lod].vertices_count = *vertices_count - ranges[lod].vertices_offset;
+    ranges[lod].indices_count = *indices_count - ranges[lod].indices_offset;
+  }
+}
+
+/* traverse every root of the (2 * grid_radius + 1)^2 grid around the camera.
+ * resets the counts of all requested outputs; unused outputs may be passed as 0.
+ *
+ * passing no outputs at all runs a count only pass: the selection is done
+ * without writing anything and the result holds the exact buffer sizes.
+ *
+ * with frame->lod_output the output is grouped by lod (lod 0 first) and the
+ * range of every lod is written to lod_output. the selection is made once into
+ * the node descriptors, which are grouped by lod before their patches are
+ * emitted, so geometry output needs the node descriptors as well
+ * (CDLOD_STATUS_INVALID otherwise). a count only pass fills the sizes per lod.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frame_traverse(
+    cdlod_frame *frame,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count)
+{
+  int root_count, i, lod;
+  cdlod_lod_range *ranges = frame->lod_output;
+  cdlod_quadtree_node root;
+  cdlod_result result;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  /* reset counts */
+  if (vertices)
+  {
+    *vertices_count = 0;
+    *indices_count = 0;
+  }
+
+  if (nodes)
+  {
+    *nodes_count = 0;
+  }
+
+  root_count = cdlod_frame_root_count(frame);
+
+  if (frame->root_grid)
+  {
+    cdlod_root_grid_begin(frame->root_grid, frame);
+  }
+
+  if (ranges)
+  {
+    for (lod = 0; lod < frame->lod_count; ++lod)
+    {
+      ranges[lod].vertices_offset = ranges[lod].vertices_count = 0;
+      ranges[lod].indices_offset = ranges[lod].indices_count = 0;
+      ranges[lod].nodes_offset = ranges[lod].nodes_count = 0;
+    }
+
+    if (vertices && !nodes)
+    {
+      result.status = CDLOD_STATUS_INVALID;
+      return result;
+    }
+
+    /* sizes per lod */
+    if (!nodes)
+    {
+      for (i = 0; i < root_count; ++i)
+      {
+        cdlod_frame_root(frame, i, &root);
+        cdlod_frame_traverse_root(frame, &root, ranges, 0, 0, 0, 0, 0, 0, 0, 0, 0, &result);
+      }
+
+      for (lod = 1; lod < frame->lod_count; ++lod)
+      {
+        ranges[lod].vertices_offset = ranges[lod - 1].vertices_offset + ranges[lod - 1].vertices_count;
+        ranges[lod].indices_offset = ranges[lod - 1].indices_offset + ranges[lod - 1].indices_count;
+        ranges[lod].nodes_offset = ranges[lod - 1].nodes_offset + ranges[lod - 1].nodes_count;
+      }
+
+      return result;
+    }
+  }
+
+  for (i = 0; i < root_count; ++i)
+  {
+    cdlod_frame_root(frame, i, &root);
+
+    /* grouped output: select into the node descriptors first */
+    if (ranges)
+    {
+      cdlod_frame_traverse_root(frame, &root, 0,
+                                0, 0, 0,
+                                0, 0, 0,
+                                nodes, nodes_capacity, nodes_count,
+                                &result);
+      continue;
+    }
+
+    cdlod_frame_traverse_root(frame, &root, 0,
+                              vertices, vertices_capacity, vertices_count,
+                              indices, indices_capacity, indices_count,
+                              nodes, nodes_capacity, nodes_count,
+                              &result);
+  }
+
+  if (ranges)
+  {
+    cdlod_frame_emit_lods(frame, ranges,
+                          vertices, vertices_capacity, vertices_count,
+                          indices, indices_capacity, indices_count,
+                          nodes, *nodes_count,
+                          &result);
+  }
+
+  return result;
+}
+
+/* floats of level memory for cdlod_frame_traverse_levels() holding up to
+ * level_capacity nodes per quadtree level
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_levels_memory_size(int level_capacity)
+{
+  return level_capacity * 6;
+}
+
+/* bit i is set if node i of 4 consecutive nodes of a level (size 2 * half,
+ * bounds mins/maxs) is selected: its squared box distance (see
+ * cdlod_node_distance_sq) lies beyond the leaf distance of the level.
+ * half = 0 classifies by the distance to the node centers.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_level_classify4(
+    float *xs, float *zs, float *mins, float *maxs, float half,
+    float camera_x, float camera_y, float camera_z, float leaf_dist_sq)
+{
+#if defined(CDLOD_SIMD_SSE2)
+  __m128 zero = _mm_setzero_ps();
+  __m128 h = _mm_set1_ps(half);
+  __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 cy = _mm_set1_ps(camera_y);
+  __m128 dx = _mm_sub_ps(_mm_set1_ps(camera_x), _mm_loadu_ps(xs));
+  __m128 dz = _mm_sub_ps(_mm_set1_ps(camera_z), _mm_loadu_ps(zs));
+  __m128 dy;
+  __m128 dist;
+
+  dx = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, dx), h), zero);
+  dz = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, dz), h), zero);
+  dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(mins), cy), _mm_sub_ps(cy, _mm_loadu_ps(maxs))), zero);
+  dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+  return _mm_movemask_ps(_mm_cmpgt_ps(dist, _mm_set1_ps(leaf_dist_sq)));
+#elif defined(CDLOD_SIMD_NEON)
+  float32x4_t zero = vdupq_n_f32(0.0f);
+  float32x4_t h = vdupq_n_f32(half);
+  float32x4_t cy = vdupq_n_f32(camera_y);
+  float32x4_t dx = vsubq_f32(vdupq_n_f32(camera_x), vld1q_f32(xs));
+  float32x4_t dz = vsubq_f32(vdupq_n_f32(camera_z), vld1q_f32(zs));
+  float32x4_t dy;
+  float32x4_t dist;
+  uint32x4_t leaf;
+
+  dx = vmaxq_f32(vsubq_f32(vabsq_f32(dx), h), zero);
+  dz = vmaxq_f32(vsubq_f32(vabsq_f32(dz), h), zero);
+  dy = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(mins), cy), vsubq_f32(cy, vld1q_f32(maxs))), zero);
+  dist = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+  leaf = vcgtq_f32(dist, vdupq_n_f32(leaf_dist_sq));
+
+  return (int)((vgetq_lane_u32(leaf, 0) & 1u) | (vgetq_lane_u32(leaf, 1) & 2u) |
+               (vgetq_lane_u32(leaf, 2) & 4u) | (vgetq_lane_u32(leaf, 3) & 8u));
+#else
+  cdlod_quadtree_node node;
+  int mask = 0;
+  int i;
+
+  node.size = half * 2.0f;
+  node.lod = 0;
+
+  for (i = 0; i < 4; ++i)
+  {
+    node.x = xs[i];
+    node.z = zs[i];
+
+    if (cdlod_node_distance_sq(&node, mins[i], maxs[i], camera_x, camera_y, camera_z) > leaf_dist_sq)
+    {
+      mask |= 1 << i;
+    }
+  }
+
+  return mask;
+#endif
+}
+
+/* breadth first variant of cdlod_frame_traverse(): all nodes of a quadtree
+ * level are kept in structure of arrays (x, z, height bounds), their center
+ * heights are sampled in batches across the whole level and 4 nodes at a time
+ * are classified against the precomputed leaf distance of the level.
+ *
+ * levels (see cdlod_frame_levels_memory_size) bounds the number of nodes per
+ * level, children that do not fit are dropped and reported as
+ * CDLOD_STATUS_STACK_FULL. selects the same nodes as cdlod_frame_traverse(),
+ * emitted coarse levels first. the output is grouped by lod by construction,
+ * frame->lod_output receives the ranges without an extra pass.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frame_traverse_levels(
+    cdlod_frame *frame,
+    float *levels, int levels_capacity,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count)
+{
+  int level_capacity = levels_capacity / 6;
+  float *xs = levels;
+  float *zs = levels + level_capacity;
+  float *next_xs = levels + level_capacity * 2;
+  float *next_zs = levels + level_capacity * 3;
+  float *mins = levels + level_capacity * 4;
+  float *maxs = levels + level_capacity * 5;
+  int use_pyramid = frame->height_pyramid != 0;
+  int patch_vertices, patch_indices;
+  int count = 0;
+  cdlod_lod_range *ranges = frame->lod_output;
+  int lod, root_count, i;
+  float size = frame->patch_size;
+  cdlod_height_source height = frame->height;
+  float camera_x = frame->camera_x;
+  float camera_y = frame->camera_y;
+  float camera_z = frame->camera_z;
+  cdlod_quadtree_node node;
+  cdlod_result result;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  if (vertices)
+  {
+    *vertices_count = 0;
+    *indices_count = 0;
+  }
+
+  if (nodes)
+  {
+    *nodes_count = 0;
+  }
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  /* visible roots form the first level */
+  root_count = cdlod_frame_root_count(frame);
+
+  for (i = 0; i < root_count; ++i)
+  {
+    cdlod_frame_root(frame, i, &node);
+
+    if (cdlod_frame_culled(frame, &node, use_pyramid))
+    {
+      continue;
+    }
+
+    if (count < level_capacity)
+    {
+      xs[count] = node.x;
+      zs[count] = node.z;
+      count++;
+    }
+    else
+    {
+      result.status |= CDLOD_STATUS_STACK_FULL;
+    }
+  }
+
+  for (lod = 0; ranges && lod < frame->lod_count; ++lod)
+  {
+    ranges[lod].vertices_offset = ranges[lod].vertices_count = 0;
+    ranges[lod].indices_offset = ranges[lod].indices_count = 0;
+    ranges[lod].nodes_offset = ranges[lod].nodes_count = 0;
+  }
+
+  for (lod = frame->lod_count - 1; lod >= 0 && count > 0; --lod)
+  {
+    float half = size * 0.5f;
+    float quarter = half * 0.5f;
+    float leaf_dist_sq = frame->lod_leaf_dist_sq[lod];
+    float batch_xs[CDLOD_HEIGHT_BATCH_SIZE];
+    float batch_zs[CDLOD_HEIGHT_BATCH_SIZE];
+    float batch_hs[CDLOD_HEIGHT_BATCH_SIZE];
+    int batch_index[CDLOD_HEIGHT_BATCH_SIZE];
+    int batch = 0;
+    int next_count = 0;
+    float *swap;
+
+    node.size = size;
+    node.lod = lod;
+
+    /* a level emits the nodes of its lod only, the ranges follow the counts
+     * (the required sizes for outputs that are not requested)
+     */
+    if (ranges)
+    {
+      ranges[lod].vertices_offset = vertices ? *vertices_count : result.vertices_required;
+      ranges[lod].indices_offset = vertices ? *indices_count : result.indices_required;
+      ranges[lod].nodes_offset = nodes ? *nodes_count : result.nodes_required;
+    }
+
+    /* height bounds: pyramid if it covers the node, otherwise a flat box at
+     * the center height, sampled in batches over the level
+     */
+    for (i = 0; i <= count; ++i)
+    {
+      int j;
+
+      if (i < count)
+      {
+        if (use_pyramid &&
+            cdlod_height_pyramid_query(frame->height_pyramid, lod, xs[i], zs[i], &mins[i], &maxs[i]))
+        {
+          continue;
+        }
+
+        batch_xs[batch] = xs[i];
+        batch_zs[batch] = zs[i];
+        batch_index[batch] = i;
+        batch++;
+      }
+
+      if (batch == CDLOD_HEIGHT_BATCH_SIZE || (i == count && batch > 0))
+      {
+        cdlod_height_source_sample(&height, batch_xs, batch_zs, batch_hs, batch);
+
+        for (j = 0; j < batch; ++j)
+        {
+          mins[batch_index[j]] = maxs[batch_index[j]] = batch_hs[j];
+        }
+
+        batch = 0;
+      }
+    }
+
+    /* pad the last group of 4 nodes with copies of the last node (a group
+     * that does not fit into the level capacity is classified one by one)
+     */
+    for (i = count; (i & 3) && i < level_capacity; ++i)
+    {
+      xs[i] = xs[count - 1];
+      zs[i] = zs[count - 1];
+      mins[i] = mins[count - 1];
+      maxs[i] = maxs[count - 1];
+    }
+
+    for (i = 0; i < count; i += 4)
+    {
+      int n = count - i < 4 ? count - i : 4;
+      int leaf_mask;
+      int j;
+
+      if (i + 4 <= level_capacity && frame->pixel_error <= 0.0f)
+      {
+        leaf_mask = cdlod_level_classify4(xs + i, zs + i, mins + i, maxs + i,
+                                          cdlod_frame_morphs(frame) ? half : 0.0f,
+                                          camera_x, camera_y, camera_z, leaf_dist_sq);
+      }
+      else
+      {
+        leaf_mask = 0;
+
+        for (j = 0; j < n; ++j)
+        {
+          node.x = xs[i + j];
+          node.z = zs[i + j];
+
+          if (cdlod_frame_leaf(frame, &node, cdlod_frame_distance_sq(frame, &node, mins[i + j], maxs[i + j], camera_x, camera_y, camera_z)))
+          {
+            leaf_mask |= 1 << j;
+          }
+        }
+      }
+
+      for (j = 0; j < n; ++j)
+      {
+        int k;
+
+        node.x = xs[i + j];
+        node.z = zs[i + j];
+
+        /* leaf node: generate patch and/or node descriptor */
+        if (leaf_mask & (1 << j))
+        {
+          cdlod_node selected;
+
+          cdlod_frame_node(frame, &node, &selected);
+          selected.seams = cdlod_frame_seams(frame, &node, &height,
+                                             frame->grid_center_x, frame->grid_center_z, frame->grid_radius,
+                                             camera_x, camera_y, camera_z);
+          if (cdlod_frame_reserve(&selected, patch_vertices, patch_indices,
+                                  vertices, vertices_capacity, vertices_count,
+                                  indices_capacity, indices_count,
+                                  nodes, nodes_capacity, nodes_count,
+                                  &result))
+          {
+            cdlod_frame_generate(frame, &node, &selected, &height,
+                                 camera_x, camera_y, camera_z,
+                                 vertices, vertices_capacity, vertices_count,
+                                 indices, indices_capacity, indices_count);
+          }
+          continue;
+        }
+
+        /* visible children go to the next level */
+        for (k = 0; k < 4; ++k)
+        {
+          cdlod_quadtree_node child;
+
+          child.x = node.x + ((k == 1 || k == 2) ? quarter : -quarter);
+          child.z = node.z + ((k >= 2) ? quarter : -quarter);
+          child.size = half;
+          child.lod = lod - 1;
+
+          if (cdlod_frame_culled(frame, &child, use_pyramid))
+          {
+            continue;
+          }
+
+          if (next_count < level_capacity)
+          {
+            next_xs[next_count] = child.x;
+            next_zs[next_count] = child.z;
+            next_count++;
+          }
+          else
+          {
+            result.status |= CDLOD_STATUS_STACK_FULL;
+          }
+        }
+      }
+    }
+
+    if (ranges)
+    {
+      ranges[lod].vertices_count = (vertices ? *vertices_count : result.vertices_required) - ranges[lod].vertices_offset;
+      ranges[lod].indices_count = (vertices ? *indices_count : result.indices_required) - ranges[lod].indices_offset;
+      ranges[lod].nodes_count = (nodes ? *nodes_count : result.nodes_required) - ranges[lod].nodes_offset;
+    }
+
+    swap = xs;
+    xs = next_xs;
+    next_xs = swap;
+    swap = zs;
+    zs = next_zs;
+    next_zs = swap;
+    count = next_count;
+    size = half;
+  }
+
+  return result;
+}
+
+/* floats of queue memory for cdlod_frame_traverse_budget() holding up to
+ * queue_capacity nodes waiting for refinement
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_budget_memory_size(int queue_capacity)
+{
+  return queue_capacity * 6;
+}
+
+/* queue entries: x, z, lod, height min, height max, priority */
+CDLOD_API CDLOD_INLINE void cdlod_budget_swap(float *queue, int a, int b)
+{
+  int i;
+
+  for (i = 0; i < 6; ++i)
+  {
+    float t = queue[a * 6 + i];
+    queue[a * 6 + i] = queue[b * 6 + i];
+    queue[b * 6 + i] = t;
+  }
+}
+
+/* max heap on the priority */
+CDLOD_API CDLOD_INLINE void cdlod_budget_push(float *queue, int *count, const float *entry)
+{
+  int i = (*count)++;
+  int j;
+
+  for (j = 0; j < 6; ++j)
+  {
+    queue[i * 6 + j] = entry[j];
+  }
+
+  while (i > 0 && queue[((i - 1) / 2) * 6 + 5] < queue[i * 6 + 5])
+  {
+    cdlod_budget_swap(queue, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+CDLOD_API CDLOD_INLINE void cdlod_budget_pop(float *queue, int *count, float *entry)
+{
+  int i = 0;
+  int j;
+
+  for (j = 0; j < 6; ++j)
+  {
+    entry[j] = queue[j];
+  }
+
+  (*count)--;
+  cdlod_budget_swap(queue, 0, *count);
+
+  for (;;)
+  {
+    int largest = i;
+    int left = i * 2 + 1;
+    int right = left + 1;
+
+    if (left < *count && queue[left * 6 + 5] > queue[largest * 6 + 5])
+    {
+      largest = left;
+    }
+
+    if (right < *count && queue[right * 6 + 5] > queue[largest * 6 + 5])
+    {
+      largest = right;
+    }
+
+    if (largest == i)
+    {
+      return;
+    }
+
+    cdlod_budget_swap(queue, i, largest);
+    i = largest;
+  }
+}
+
+/* refinement priority of a node: squared distance below which it is
+ * subdivided over its squared box distance (> 1 = wants to be subdivided)
+ */
+CDLOD_API CDLOD_INLINE float cdlod_frame_priority(cdlod_frame *frame, cdlod_quadtree_node *node, float dist)
+{
+  float leaf_dist_sq = frame->lod_leaf_dist_sq[node->lod];
+
+  if (frame->pixel_error > 0.0f)
+  {
+    leaf_dist_sq = frame->lod_screen_distance[node->lod];
+    leaf_dist_sq *= leaf_dist_sq;
+  }
+
+  return leaf_dist_sq / (dist > 0.0001f ? dist : 0.0001f);
+}
+
+/* select a node that is a leaf (or does not fit into the queue), otherwise
+ * queue it for refinement
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_budget_add(
+    cdlod_frame *frame, cdlod_quadtree_node *node, cdlod_height_source *height,
+    float *queue, int queue_capacity, int *queue_count,
+    int patch_vertices, int patch_indices,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count,
+    cdlod_result *result)
+{
+  float entry[6];
+  float node_min, node_max, dist;
+
+  if (!frame->height_pyramid ||
+      !cdlod_height_pyramid_query(frame->height_pyramid, node->lod, node->x, node->z, &node_min, &node_max))
+  {
+    cdlod_height_source_sample(height, &node->x, &node->z, &node_min, 1);
+    node_max = node_min;
+  }
+
+  dist = cdlod_frame_distance_sq(frame, node, node_min, node_max, frame->camera_x, frame->camera_y, frame->camera_z);
+
+  if (!cdlod_frame_leaf(frame, node, dist))
+  {
+    if (*queue_count < queue_capacity)
+    {
+      entry[0] = node->x;
+      entry[1] = node->z;
+      entry[2] = (float)node->lod;
+      entry[3] = node_min;
+      entry[4] = node_max;
+      entry[5] = cdlod_frame_priority(frame, node, dist);
+      cdlod_budget_push(queue, queue_count, entry);
+      return;
+    }
+
+    result->status |= CDLOD_STATUS_STACK_FULL;
+  }
+
+  cdlod_frame_emit_node(frame, node, height, 0, patch_vertices, patch_indices,
+                        vertices, vertices_capacity, vertices_count,
+                        indices, indices_capacity, indices_count,
+                        nodes, nodes_capacity, nodes_count,
+                        result);
+}
+
+/* budgeted variant of cdlod_frame_traverse(): starts from the visible roots
+ * and subdivides the node with the highest priority (see cdlod_frame_priority,
+ * projected error in screen space error mode, lod range over distance
+ * otherwise) as long as its visible children fit into vertex_budget vertices
+ * and triangle_budget triangles (0 = unlimited). without reaching the budget
+ * it selects the same nodes as cdlod_frame_traverse(). a node whose visible
+ * children do not fit is selected as it is and CDLOD_STATUS_BUDGET is
+ * reported, refinement goes on with the next node (nodes with fewer visible
+ * children may still fit), so detail degrades from the least important nodes
+ * first instead of dropping patches in root order.
+ *
+ * the visible roots are always selected, if they alone exceed the budget
+ * CDLOD_STATUS_OVER_BUDGET is reported as well (nothing is refined then).
+ * queue (see cdlod_frame_budget_memory_size) bounds the nodes waiting
+ * for refinement, nodes that do not fit are selected without refinement and
+ * reported as CDLOD_STATUS_STACK_FULL. stitched seams (CDLOD_SEAM_STITCH)
+ * assume the unbudgeted selection and can leave cracks once the budget is
+ * reached.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frame_traverse_budget(
+    cdlod_frame *frame,
+    float *queue, int queue_size,
+    int vertex_budget, int triangle_budget,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count)
+{
+  int queue_capacity = queue_size / 6;
+  int queue_count = 0;
+  int use_pyramid = frame->height_pyramid != 0;
+  int budget_vertices = 0;
+  int budget_triangles = 0;
+  int patch_vertices, patch_indices, patch_budget_vertices, patch_budget_triangles;
+  int root_count, i, k;
+  cdlod_height_source height = frame->height;
+  cdlod_quadtree_node node;
+  cdlod_quadtree_node children[4];
+  cdlod_result result;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  if (vertices)
+  {
+    *vertices_count = 0;
+    *indices_count = 0;
+  }
+
+  if (nodes)
+  {
+    *nodes_count = 0;
+  }
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+  patch_budget_vertices = patch_vertices / cdlod_frame_vertex_stride(frame);
+  patch_budget_triangles = patch_indices / 3;
+
+  /* every node selected or queued counts as one patch */
+  root_count = cdlod_frame_root_count(frame);
+
+  for (i = 0; i < root_count; ++i)
+  {
+    cdlod_frame_root(frame, i, &node);
+
+    if (cdlod_frame_culled(frame, &node, use_pyramid))
+    {
+      continue;
+    }
+
+    budget_vertices += patch_budget_vertices;
+    budget_triangles += patch_budget_triangles;
+
+    cdlod_frame_budget_add(frame, &node, &height, queue, queue_capacity, &queue_count,
+                           patch_vertices, patch_indices,
+                           vertices, vertices_capacity, vertices_count,
+                           indices, indices_capacity, indices_count,
+                           nodes, nodes_capacity, nodes_count,
+                           &result);
+  }
+
+  if ((vertex_budget > 0 && budget_vertices > vertex_budget) ||
+      (triangle_budget > 0 && budget_triangles > triangle_budget))
+  {
+    result.status |= CDLOD_STATUS_OVER_BUDGET;
+  }
+
+  /* refine by priority, nodes whose visible children do not fit stay as they are */
+  while (queue_count > 0)
+  {
+    float entry[6];
+    float quarter;
+    int child_count = 0;
+
+    cdlod_budget_pop(queue, &queue_count, entry);
+
+    node.x = entry[0];
+    node.z = entry[1];
+    node.lod = (int)entry[2];
+    node.size = frame->lod_max_size[node.lod];
+    quarter = node.size * 0.25f;
+
+    for (k = 0; k < 4; ++k)
+    {
+      cdlod_quadtree_node *child = &children[child_count];
+
+      child->x = node.x + ((k == 1 || k == 2) ? quarter : -quarter);
+      child->z = node.z + ((k >= 2) ? quarter : -quarter);
+      child->size = node.size * 0.5f;
+      child->lod = node.lod - 1;
+
+      child_count += !cdlod_frame_culled(frame, child, use_pyramid);
+    }
+
+    /* the children replace the node */
+    if ((vertex_budget > 0 && budget_vertices + (child_count - 1) * patch_budget_vertices > vertex_budget) ||
+        (triangle_budget > 0 && budget_triangles + (child_count - 1) * patch_budget_triangles > triangle_budget))
+    {
+      result.status |= CDLOD_STATUS_BUDGET;
+      cdlod_frame_emit_node(frame, &node, &height, 0, patch_vertices, patch_indices,
+                            vertices, vertices_capacity, vertices_count,
+                            indices, indices_capacity, indices_count,
+                            nodes, nodes_capacity, nodes_count,
+                            &result);
+      continue;
+    }
+
+    budget_vertices += (child_count - 1) * patch_budget_vertices;
+    budget_triangles += (child_count - 1) * patch_budget_triangles;
+
+    for (k = 0; k < child_count; ++k)
+    {
+      cdlod_frame_budget_add(frame, &children[k], &height, queue, queue_capacity, &queue_count,
+                             patch_vertices, patch_indices,
+                             vertices, vertices_capacity, vertices_count,
+                             indices, indices_capacity, indices_count,
+                             nodes, nodes_capacity, nodes_count,
+                             &result);
+    }
+  }
+
+  return result;
+}
+
+/* horizontal distance from the camera to the box of a selected node */
+CDLOD_API CDLOD_INLINE float cdlod_frame_node_distance(cdlod_frame *frame, cdlod_node *node)
+{
+  cdlod_quadtree_node box;
+  float dist;
+
+  box.x = node->x;
+  box.z = node->z;
+  box.size = node->size;
+  box.lod = node->lod;
+
+  dist = cdlod_node_distance_sq(&box, frame->camera_y, frame->camera_y,
+                                frame->camera_x, frame->camera_y, frame->camera_z);
+
+  return dist > 0.0f ? cdlod_sqrtf(dist) : 0.0f;
+}
+
+/* front to back draw order of selected nodes for early depth rejection.
+ * nodes are distributed into bucket_count distance buckets of equal width
+ * between the camera and the farthest node (counting sort, buckets holds
+ * bucket_count ints, distances nodes_count floats of scratch), nodes within a
+ * bucket keep their selection order. bucket_count < 1 keeps the selection order.
+ * order[i] receives the index of the node drawn at position i, so nodes[order[i]]
+ * can be drawn (or copied) in that order.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_front_to_back(
+    cdlod_frame *frame, cdlod_node *nodes, int nodes_count,
+    float *distances, int *buckets, int bucket_count,
+    int *order)
+{
+  float max_distance = 0.0f;
+  float scale;
+  int offset = 0;
+  int i;
+
+  if (bucket_count < 1)
+  {
+    for (i = 0; i < nodes_count; ++i)
+    {
+      order[i] = i;
+    }
+
+    return;
+  }
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    distances[i] = cdlod_frame_node_distance(frame, &nodes[i]);
+    max_distance = distances[i] > max_distance ? distances[i] : max_distance;
+  }
+
+  scale = max_distance > 0.0f ? (float)bucket_count / max_distance : 0.0f;
+
+  for (i = 0; i < bucket_count; ++i)
+  {
+    buckets[i] = 0;
+  }
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int bucket = (int)(distances[i] * scale);
+    buckets[bucket < bucket_count ? bucket : bucket_count - 1]++;
+  }
+
+  /* bucket sizes to start offsets */
+  for (i = 0; i < bucket_count; ++i)
+  {
+    int size = buckets[i];
+    buckets[i] = offset;
+    offset += size;
+  }
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int bucket = (int)(distances[i] * scale);
+    order[buckets[bucket < bucket_count ? bucket : bucket_count - 1]++] = i;
+  }
+}
+
+/* copy the patches emitted by a traversal together with nodes (patch i belongs
+ * to nodes[i]) in the draw order of cdlod_frame_front_to_back(). the outputs
+ * must hold nodes_count patches. returns 0 for stitched patches
+ * (CDLOD_SEAM_STITCH), their index counts differ per node: emit them from the
+ * ordered nodes with cdlod_frame_emit_layout() instead.
+ */
+CDLOD_API CDLOD_INLINE int cdlod_frame_order_patches(
+    cdlod_frame *frame, cdlod_node *nodes, int *order, int nodes_count,
+    const float *source_vertices, const int *source_indices,
+    float *vertices, int *vertices_count,
+    int *indices, int *indices_count)
+{
+  int patch_vertices, patch_indices;
+  int stride = cdlod_frame_vertex_stride(frame);
+  int i;
+
+  if (frame->seam_mode == CDLOD_SEAM_STITCH && frame->patch_resolution >= 2)
+  {
+    return 0;
+  }
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  *vertices_count = 0;
+  *indices_count = 0;
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int patch = order[i];
+
+    cdlod_frame_copy_patch(frame, &nodes[patch],
+                           frame->camera_x, frame->camera_y, frame->camera_z,
+                           source_vertices + patch * patch_vertices,
+                           source_indices + patch * patch_indices,
+                           patch * patch_vertices / stride,
+                           patch_vertices, patch_indices,
+                           vertices, vertices_count,
+                           indices, indices_count);
+  }
+
+  return 1;
+}
+
+/* emit the geometry of selected node descriptors (from a node selection, the
+ * added slots of a cdlod_selection, a view, ...) into a vertex layout.
+ * frames with single quads (patch_resolution < 2) emit unmorphed 2 x 2 grid
+ * patches. vertices_required of the result counts layout vertices.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frame_emit_layout(
+    cdlod_frame *frame, cdlod_node *nodes, int nodes_count,
+    cdlod_layout *layout,
+    int *indices, int indices_capacity, int *indices_count)
+{
+  int patch_resolution = frame->patch_resolution < 2 ? 2 : frame->patch_resolution;
+  cdlod_morph_mode morph_mode = frame->patch_resolution < 2 ? CDLOD_MORPH_NONE : frame->morph_mode;
+  cdlod_height_source height = frame->height;
+  cdlod_result result;
+  int i;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  layout->count = 0;
+  *indices_count = 0;
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int stitched = nodes[i].seams & CDLOD_SEAMS_STITCHED;
+    int patch_vertices = cdlod_grid_patch_vertex_count_seams(patch_resolution, stitched);
+    int patch_indices = cdlod_grid_patch_index_count_seams(patch_resolution, stitched);
+
+    result.nodes_required++;
+    result.vertices_required += patch_vertices;
+    result.indices_required += patch_indices;
+
+    if (layout->count + patch_vertices > layout->capacity)
+    {
+      result.status |= CDLOD_STATUS_VERTICES_FULL;
+    }
+
+    if (*indices_count + patch_indices > indices_capacity)
+    {
+      result.status |= CDLOD_STATUS_INDICES_FULL;
+    }
+
+    cdlod_generate_grid_patch_layout(layout,
+                                     indices, indices_capacity, indices_count,
+                                     &nodes[i], &height, frame->skirt_depth,
+                                     patch_resolution, morph_mode,
+                                     frame->camera_x, frame->camera_y, frame->camera_z);
+  }
+
+  return result;
+}
+
+/* quantized output
+ *
+ * patch vertices as signed 16 bit offsets from the center of their node and
+ * patch local 16 bit indices (draw every patch with its own base vertex). all
+ * components are signed normalized (snorm16, e.g. a SHORT4N attribute):
+ *
+ *   x = node.x + qx / 32767 * node.size / 2     (same for z)
+ *   y = (height_min + height_max) / 2 + qy / 32767 * (height_max - height_min) / 2
+ *   k = qk / 32767                              (CDLOD_MORPH_FACTOR only)
+ *
+ * vertices are stored as qx, qy, qz (, qk). heights outside of the range
+ * (including skirts) are clamped, so include the skirt depth in height_min.
+ */
+CDLOD_API CDLOD_INLINE short cdlod_quantize(float value)
+{
+  value = value < -32767.0f ? -32767.0f : (value > 32767.0f ? 32767.0f : value);
+  return (short)(value < 0.0f ? value - 0.5f : value + 0.5f);
+}
+
+/* quantize vertex_count vertices (stride floats each: xyz and optional k at 3) of node */
+CDLOD_API CDLOD_INLINE void cdlod_quantize_patch(
+    cdlod_node *node, const float *vertices, int vertex_count, int stride,
+    float height_min, float height_max,
+    short *out)
+{
+  float position_scale = 65534.0f / node->size;
+  float height_center = (height_min + height_max) * 0.5f;
+  float height_scale = height_max > height_min ? 65534.0f / (height_max - height_min) : 0.0f;
+  int i;
+
+  for (i = 0; i < vertex_count; ++i)
+  {
+    const float *v = vertices + i * stride;
+
+    *out++ = cdlod_quantize((v[0] - node->x) * position_scale);
+    *out++ = cdlod_quantize((v[1] - height_center) * height_scale);
+    *out++ = cdlod_quantize((v[2] - node->z) * position_scale);
+
+    if (stride == 4)
+    {
+      *out++ = cdlod_quantize(v[3] * 32767.0f);
+    }
+  }
+}
+
+/* emit selected node descriptors as quantized patches. scratch holds one float
+ * patch (see cdlod_frame_patch_size). vertex counts are in shorts, every
+ * patch starts at a multiple of the patch size. frames with single quads
+ * (patch_resolution < 2) emit 2 x 2 grid patches. patches with more than 65536
+ * vertices (patch_resolution > 254 with skirts, > 256 stitched) can not use 16
+ * bit indices and return CDLOD_STATUS_INVALID.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frame_emit_quantized(
+    cdlod_frame *frame, cdlod_node *nodes, int nodes_count,
+    float *scratch_vertices, int *scratch_indices,
+    short *vertices, int vertices_capacity, int *vertices_count,
+    unsigned short *indices, int indices_capacity, int *indices_count,
+    float height_min, float height_max)
+{
+  int patch_resolution = frame->patch_resolution < 2 ? 2 : frame->patch_resolution;
+  cdlod_morph_mode morph_mode = frame->patch_resolution < 2 ? CDLOD_MORPH_NONE : frame->morph_mode;
+  int stride = morph_mode == CDLOD_MORPH_FACTOR ? 4 : 3;
+  cdlod_height_source height = frame->height;
+  cdlod_result result;
+  int i, j;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  *vertices_count = 0;
+  *indices_count = 0;
+
+  if (cdlod_grid_patch_vertex_count_seams(patch_resolution, frame->seam_mode == CDLOD_SEAM_STITCH) > 65536)
+  {
+    result.status = CDLOD_STATUS_INVALID;
+    return result;
+  }
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int stitched = nodes[i].seams & CDLOD_SEAMS_STITCHED;
+    int patch_vertices = cdlod_grid_patch_vertex_count_seams(patch_resolution, stitched);
+    int patch_indices = cdlod_grid_patch_index_count_seams(patch_resolution, stitched);
+    int scratch_vertices_count = 0;
+    int scratch_indices_count = 0;
+    int fits = 1;
+
+    result.nodes_required++;
+    result.vertices_required += patch_vertices * stride;
+    result.indices_required += patch_indices;
+
+    if (*vertices_count + patch_vertices * stride > vertices_capacity)
+    {
+      result.status |= CDLOD_STATUS_VERTICES_FULL;
+      fits = 0;
+    }
+
+    if (*indices_count + patch_indices > indices_capacity)
+    {
+      result.status |= CDLOD_STATUS_INDICES_FULL;
+      fits = 0;
+    }
+
+    if (!fits)
+    {
+      continue;
+    }
+
+    cdlod_generate_grid_patch(scratch_vertices, patch_vertices * stride, &scratch_vertices_count,
+                              scratch_indices, patch_indices, &scratch_indices_count,
+                              &nodes[i], &height, frame->skirt_depth,
+                              patch_resolution, morph_mode,
+                              frame->camera_x, frame->camera_y, frame->camera_z);
+
+    cdlod_quantize_patch(&nodes[i], scratch_vertices, patch_vertices, stride,
+                         height_min, height_max,
+                         vertices + *vertices_count);
+
+    /* patch local indices (stitched patches may use fewer) */
+    for (j = 0; j < scratch_indices_count; ++j)
+    {
+      indices[*indices_count + j] = (unsigned short)scratch_indices[j];
+    }
+
+    *vertices_count += patch_vertices * stride;
+    *indices_count += scratch_indices_count;
+  }
+
+  return result;
+}
+
+/* jobs
+ *
+ * the roots of a frame are independent of each other, so the root grid can be
+ * split into jobs that are traversed on any thread into their own buffers and
+ * merged afterwards. the header does not depend on any threading api:
+ *
+ *   cdlod_frame_jobs(&frame, jobs, job_count);
+ *   (set the output buffers of every job)
+ *   cdlod_job_run(&frame, &jobs[i]);       on any thread, once per job
+ *   cdlod_jobs_merge(&frame, jobs, ...);   after all jobs finished
+ *
+ * the frame is only read while jobs run, the height source has to be thread
+ * safe. the merged output holds the same patches as cdlod_frame_traverse(),
+ * with frame->lod_output grouped by lod (the order within a lod may differ).
+ * the root grid is not used by jobs (every root is traversed) and a patch
+ * cache can not be shared between them (CDLOD_STATUS_INVALID).
+ */
+typedef struct cdlod_job
+{
+  int root_begin; /* first root (see cdlod_frame_root) */
+  int root_end;   /* one past the last root */
+
+  /* job local outputs, unused outputs may be 0 */
+  float *vertices;
+  int vertices_capacity;
+  int vertices_count;
+  int *indices;
+  int indices_capacity;
+  int indices_count;
+  cdlod_node *nodes;
+  int nodes_capacity;
+  int nodes_count;
+
+  cdlod_result result;
+
+  /* position of the job output in the merged buffers (cdlod_jobs_prefix_sum) */
+  int vertices_offset;
+  int indices_offset;
+  int nodes_offset;
+
+  /* with frame->lod_output: the job local range of every lod and its position
+   * in the merged buffers (cdlod_jobs_prefix_sum)
+   */
+  cdlod_lod_range lod_ranges[CDLOD_MAX_LODS];
+  cdlod_lod_range lod_offsets[CDLOD_MAX_LODS];
+
+} cdlod_job;
+
+/* split the root grid into job_count contiguous ranges of (almost) equal size.
+ * the outputs of every job are reset and have to be set by the caller.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_frame_jobs(cdlod_frame *frame, cdlod_job *jobs, int job_count)
+{
+  int root_count = cdlod_frame_root_count(frame);
+  int i;
+
+  for (i = 0; i < job_count; ++i)
+  {
+    cdlod_job *job = &jobs[i];
+
+    job->root_begin = root_count * i / job_count;
+    job->root_end = root_count * (i + 1) / job_count;
+
+    job->vertices = 0;
+    job->vertices_capacity = 0;
+    job->vertices_count = 0;
+    job->indices = 0;
+    job->indices_capacity = 0;
+    job->indices_count = 0;
+    job->nodes = 0;
+    job->nodes_capacity = 0;
+    job->nodes_count = 0;
+
+    job->vertices_offset = 0;
+    job->indices_offset = 0;
+    job->nodes_offset = 0;
+  }
+}
+
+/* traverse the roots of a job into its own buffers (safe to call concurrently
+ * for different jobs). with frame->lod_output the job output is grouped by lod
+ * like cdlod_frame_traverse() does, geometry needs the node descriptors then.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_job_run(cdlod_frame *frame, cdlod_job *job)
+{
+  cdlod_lod_range *ranges = frame->lod_output ? job->lod_ranges : 0;
+  int count_only = !job->vertices && !job->nodes;
+  cdlod_quadtree_node root;
+  int i, lod;
+
+  job->result.status = CDLOD_STATUS_OK;
+  job->result.vertices_required = 0;
+  job->result.indices_required = 0;
+  job->result.nodes_required = 0;
+
+  job->vertices_count = 0;
+  job->indices_count = 0;
+  job->nodes_count = 0;
+
+  for (lod = 0; lod < CDLOD_MAX_LODS; ++lod)
+  {
+    job->lod_ranges[lod].vertices_offset = job->lod_ranges[lod].vertices_count = 0;
+    job->lod_ranges[lod].indices_offset = job->lod_ranges[lod].indices_count = 0;
+    job->lod_ranges[lod].nodes_offset = job->lod_ranges[lod].nodes_count = 0;
+  }
+
+  /* the patch cache is not thread safe */
+  if (frame->patch_cache || (ranges && job->vertices && !job->nodes))
+  {
+    job->result.status = CDLOD_STATUS_INVALID;
+    return;
+  }
+
+  for (i = job->root_begin; i < job->root_end; ++i)
+  {
+    cdlod_frame_root(frame, i, &root);
+
+    /* grouped output: count the sizes per lod or select into the node descriptors first */
+    if (ranges)
+    {
+      cdlod_quadtree_traverse(frame, root, count_only ? ranges : 0,
+                              0, 0, 0,
+                              0, 0, 0,
+                              job->nodes, job->nodes_capacity, &job->nodes_count,
+                              &job->result, 0);
+      continue;
+    }
+
+    cdlod_quadtree_traverse(frame, root, 0,
+                            job->vertices, job->vertices_capacity, &job->vertices_count,
+                            job->indices, job->indices_capacity, &job->indices_count,
+                            job->nodes, job->nodes_capacity, &job->nodes_count,
+                            &job->result, 0);
+  }
+
+  if (ranges && !count_only)
+  {
+    cdlod_frame_emit_lods(frame, ranges,
+                          job->vertices, job->vertices_capacity, &job->vertices_count,
+                          job->indices, job->indices_capacity, &job->indices_count,
+                          job->nodes, job->nodes_count,
+                          &job->result);
+  }
+}
+
+/* exclusive prefix sum over the job outputs. returns the combined result of
+ * all jobs, the required sizes are the sizes of the merged buffers. with
+ * frame->lod_output the jobs are placed lod by lod and the merged ranges are
+ * written to lod_output.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_jobs_prefix_sum(cdlod_frame *frame, cdlod_job *jobs, int job_count)
+{
+  cdlod_result result;
+  int vertices_offset = 0;
+  int indices_offset = 0;
+  int nodes_offset = 0;
+  int i, lod;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  for (i = 0; i < job_count; ++i)
+  {
+    cdlod_job *job = &jobs[i];
+
+    job->vertices_offset = vertices_offset;
+    job->indices_offset = indices_offset;
+    job->nodes_offset = nodes_offset;
+
+    vertices_offset += job->vertices_count;
+    indices_offset += job->indices_count;
+    nodes_offset += job->nodes_count;
+
+    result.status |= job->result.status;
+    result.vertices_required += job->result.vertices_required;
+    result.indices_required += job->result.indices_required;
+    result.nodes_required += job->result.nodes_required;
+  }
+
+  if (!frame->lod_output)
+  {
+    return result;
+  }
+
+  vertices_offset = 0;
+  indices_offset = 0;
+  nodes_offset = 0;
+
+  for (lod = 0; lod < frame->lod_count; ++lod)
+  {
+    cdlod_lod_range *merged = &frame->lod_output[lod];
+
+    merged->vertices_offset = vertices_offset;
+    merged->indices_offset = indices_offset;
+    merged->nodes_offset = nodes_offset;
+
+    for (i = 0; i < job_count; ++i)
+    {
+      cdlod_lod_range *range = &jobs[i].lod_ranges[lod];
+      cdlod_lod_range *offset = &jobs[i].lod_offsets[lod];
+
+      *offset = *range;
+      offset->vertices_offset = vertices_offset;
+      offset->indices_offset = indices_offset;
+      offset->nodes_offset = nodes_offset;
+
+      vertices_offset += range->vertices_count;
+      indices_offset += range->indices_count;
+      nodes_offset += range->nodes_count;
+    }
+
+    merged->vertices_count = vertices_offset - merged->vertices_offset;
+    merged->indices_count = indices_offset - merged->indices_offset;
+    merged->nodes_count = nodes_offset - merged->nodes_offset;
+  }
+
+  return result;
+}
+
+/* copy the range from of a job output to the range to of the merged buffers
+ * and rebase its indices
+ */
+CDLOD_API CDLOD_INLINE void cdlod_job_copy_range(
+    cdlod_frame *frame, cdlod_job *job,
+    cdlod_lod_range *from, cdlod_lod_range *to,
+    float *vertices, int *indices, cdlod_node *nodes)
+{
+  int base_vertex = (to->vertices_offset - from->vertices_offset) / cdlod_frame_vertex_stride(frame);
+  int i;
+
+  if (vertices && job->vertices)
+  {
+    for (i = 0; i < from->vertices_count; ++i)
+    {
+      vertices[to->vertices_offset + i] = job->vertices[from->vertices_offset + i];
+    }
+
+    for (i = 0; i < from->indices_count; ++i)
+    {
+      indices[to->indices_offset + i] = job->indices[from->indices_offset + i] + base_vertex;
+    }
+  }
+
+  if (nodes && job->nodes)
+  {
+    for (i = 0; i < from->nodes_count; ++i)
+    {
+      nodes[to->nodes_offset + i] = job->nodes[from->nodes_offset + i];
+    }
+  }
+}
+
+/* copy a job output to its offsets (see cdlod_jobs_prefix_sum) and rebase its
+ * indices. jobs write disjoint ranges, so copies may run concurrently. the
+ * caller guarantees the buffers hold the sums of all job counts.
+ */
+CDLOD_API CDLOD_INLINE void cdlod_job_copy(
+    cdlod_frame *frame, cdlod_job *job,
+    float *vertices, int *indices, cdlod_node *nodes)
+{
+  cdlod_lod_range from, to;
+  int lod;
+
+  if (frame->lod_output)
+  {
+    for (lod = 0; lod < frame->lod_count; ++lod)
+    {
+      cdlod_job_copy_range(frame, job, &job->lod_ranges[lod], &job->lod_offsets[lod], vertices, indices, nodes);
+    }
+    return;
+  }
+
+  from.vertices_offset = 0;
+  from.vertices_count = job->vertices_count;
+  from.indices_offset = 0;
+  from.indices_count = job->indices_count;
+  from.nodes_offset = 0;
+  from.nodes_count = job->nodes_count;
+
+  to = from;
+  to.vertices_offset = job->vertices_offset;
+  to.indices_offset = job->indices_offset;
+  to.nodes_offset = job->nodes_offset;
+
+  cdlod_job_copy_range(frame, job, &from, &to, vertices, indices, nodes);
+}
+
+/* merge all finished jobs into the final buffers in root order. unused outputs
+ * may be passed as 0. if a buffer is too small nothing is written to it and its
+ * CDLOD_STATUS_*_FULL flag is set.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_jobs_merge(
+    cdlod_frame *frame, cdlod_job *jobs, int job_count,
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count)
+{
+  cdlod_result result = cdlod_jobs_prefix_sum(frame, jobs, job_count);
+  int total_vertices = job_count > 0 ? jobs[job_count - 1].vertices_offset + jobs[job_count - 1].vertices_count : 0;
+  int total_indices = job_count > 0 ? jobs[job_count - 1].indices_offset + jobs[job_count - 1].indices_count : 0;
+  int total_nodes = job_count > 0 ? jobs[job_count - 1].nodes_offset + jobs[job_count - 1].nodes_count : 0;
+  int i;
+
+  if (vertices)
+  {
+    *vertices_count = 0;
+    *indices_count = 0;
+
+    if (total_vertices > vertices_capacity)
+    {
+      result.status |= CDLOD_STATUS_VERTICES_FULL;
+      vertices = 0;
+    }
+
+    if (total_indices > indices_capacity)
+    {
+      result.status |= CDLOD_STATUS_INDICES_FULL;
+      vertices = 0;
+    }
+  }
+
+  if (nodes)
+  {
+    *nodes_count = 0;
+
+    if (total_nodes > nodes_capacity)
+    {
+      result.status |= CDLOD_STATUS_NODES_FULL;
+      nodes = 0;
+    }
+  }
+
+  for (i = 0; i < job_count; ++i)
+  {
+    cdlod_job_copy(frame, &jobs[i], vertices, indices, nodes);
+  }
+
+  if (vertices)
+  {
+    *vertices_count = total_vertices;
+    *indices_count = total_indices;
+  }
+
+  if (nodes)
+  {
+    *nodes_count = total_nodes;
+  }
+
+  return result;
+}
+
+/* views
+ *
+ * several cameras (e.g. the clients of a server) can share one traversal of
+ * the frame settings. nodes that are seen by more than one view are visited
+ * once, their center heights are sampled once and a patch selected by several
+ * views is only sampled for the first of them and copied for the others.
+ *
+ *   cdlod_view_init(&views[i], &frame, camera..., forward...);
+ *   (set the output buffers of every view)
+ *   cdlod_frame_traverse_views(&frame, views, view_count);
+ *
+ * the output of every view is identical to cdlod_frame_traverse() with the
+ * frame set up for its camera and without lod_output, root_grid and
+ * patch_cache: views do not group their output by lod, do not fill lod_output
+ * and do not use the root grid or the patch cache. the frame camera is not
+ * used, frustum culling (if enabled) applies to all views.
+ */
+#ifndef CDLOD_MAX_VIEWS
+#define CDLOD_MAX_VIEWS 32 /* bits of the view masks (unsigned long) */
+#endif
+
+typedef struct cdlod_view
+{
+  float camera_x, camera_y, camera_z;
+  int grid_center_x, grid_center_z;
+
+  /* outputs, unused outputs may be 0 */
+  float *vertices;
+  int vertices_capacity;
+  int vertices_count;
+  int *indices;
+  int indices_capacity;
+  int indices_count;
+  cdlod_node *nodes;
+  int nodes_capacity;
+  int nodes_count;
+
+  cdlod_result result;
+
+} cdlod_view;
+
+/* set the camera of a view and reset its outputs (which have to be set by the caller) */
+CDLOD_API CDLOD_INLINE void cdlod_view_init(
+    cdlod_view *view, cdlod_frame *frame,
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z)
+{
+  view->camera_x = camera_x;
+  view->camera_y = camera_y;
+  view->camera_z = camera_z;
+
+  cdlod_grid_center(camera_x, camera_z, forward_x, forward_z,
+                    frame->patch_size, frame->grid_radius,
+                    &view->grid_center_x, &view->grid_center_z);
+
+  view->vertices = 0;
+  view->vertices_capacity = 0;
+  view->vertices_count = 0;
+  view->indices = 0;
+  view->indices_capacity = 0;
+  view->indices_count = 0;
+  view->nodes = 0;
+  view->nodes_capacity = 0;
+  view->nodes_count = 0;
+}
+
+/* traverse one root for all views in root_views (bit i = views[i]) */
+CDLOD_API CDLOD_INLINE void cdlod_quadtree_traverse_views(
+    cdlod_frame *frame, cdlod_quadtree_node root, unsigned long root_views,
+    cdlod_view *views, int view_count)
+{
+  cdlod_quadtree_node stack[64];
+  unsigned long stack_views[64]; /* views that still subdivide towards the node */
+  float stack_height[64];        /* node center heights (only without height bounds) */
+  int stack_size = 0;
+  int root_bounds;
+  float root_min, root_max;
+
+  int patch_vertices, patch_indices;
+  int stride = cdlod_frame_vertex_stride(frame);
+
+  /* position morphed and stitched patches depend on the camera and can not be shared */
+  int share_patches = frame->patch_resolution < 2 ||
+                      (frame->morph_mode != CDLOD_MORPH_POSITION && frame->seam_mode != CDLOD_SEAM_STITCH);
+
+  cdlod_height_source height = frame->height;
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  root_bounds = frame->height_pyramid &&
+                cdlod_height_pyramid_query(frame->height_pyramid, root.lod, root.x, root.z,
+                                           &root_min, &root_max);
+
+  if (cdlod_frame_culled(frame, &root, root_bounds))
+  {
+    return;
+  }
+
+  if (!root_bounds)
+  {
+    cdlod_height_source_sample(&height, &root.x, &root.z, &stack_height[0], 1);
+  }
+
+  stack_views[stack_size] = root_views;
+  stack[stack_size++] = root;
+
+  while (stack_size > 0)
+  {
+    cdlod_quadtree_node node = stack[--stack_size];
+    unsigned long node_views = stack_views[stack_size];
+    unsigned long leaf_views = 0;
+    unsigned long split_views = 0;
+    float half = node.size * 0.5f;
+    float node_min, node_max;
+    int i;
+
+    if (!root_bounds ||
+        !cdlod_height_pyramid_query(frame->height_pyramid, node.lod, node.x, node.z, &node_min, &node_max))
+    {
+      node_min = node_max = stack_height[stack_size]; /* popped node */
+    }
+
+    /* classify the node per view */
+    for (i = 0; i < view_count; ++i)
+    {
+      cdlod_view *view = &views[i];
+      unsigned long bit = 1UL << i;
+      float dist;
+
+      if (!(node_views & bit))
+      {
+        continue;
+      }
+
+      dist = cdlod_frame_distance_sq(frame, &node, node_min, node_max, view->camera_x, view->camera_y, view->camera_z);
+
+      if (cdlod_frame_leaf(frame, &node, dist))
+      {
+        leaf_views |= bit;
+      }
+      else
+      {
+        split_views |= bit;
+      }
+    }
+
+    /* leaf for some views: generate once, copy for the others */
+    if (leaf_views)
+    {
+      cdlod_node selected;
+      cdlod_view *source = 0;
+      int source_vertices = 0;
+      int source_indices = 0;
+
+      cdlod_frame_node(frame, &node, &selected);
+
+      for (i = 0; i < view_count; ++i)
+      {
+        cdlod_view *view = &views[i];
+
+        if (!(leaf_views & (1UL << i)))
+        {
+          continue;
+        }
+
+        selected.seams = cdlod_frame_seams(frame, &node, &height,
+                                           view->grid_center_x, view->grid_center_z, frame->grid_radius,
+                                           view->camera_x, view->camera_y, view->camera_z);
+
+        if (!cdlod_frame_reserve(&selected, patch_vertices, patch_indices,
+                                 view->vertices, view->vertices_capacity, &view->vertices_count,
+                                 view->indices_capacity, &view->indices_count,
+                                 view->nodes, view->nodes_capacity, &view->nodes_count,
+                                 &view->result))
+        {
+          continue;
+        }
+
+        if (source)
+        {
+          cdlod_frame_copy_patch(frame, &selected,
+                                 view->camera_x, view->camera_y, view->camera_z,
+                                 source->vertices + source_vertices,
+                                 source->indices + source_indices,
+                                 source_vertices / stride,
+                                 patch_vertices, patch_indices,
+                                 view->vertices, &view->vertices_count,
+                                 view->indices, &view->indices_count);
+          continue;
+        }
+
+        if (share_patches)
+        {
+          source = view;
+          source_vertices = view->vertices_count;
+          source_indices = view->indices_count;
+        }
+
+        cdlod_frame_generate(frame, &node, &selected, &height,
+                             view->camera_x, view->camera_y, view->camera_z,
+                             view->vertices, view->vertices_capacity, &view->vertices_count,
+                             view->indices, view->indices_capacity, &view->indices_count);
+      }
+    }
+
+    if (!split_views)
+    {
+      continue;
+    }
+
+    /* subdivide for the remaining views */
+    if (stack_size + 4 <= 64)
+    {
+      float quarter = half * 0.5f;
+      int pushed = 0;
+
+      for (i = 0; i < 4; ++i)
+      {
+        cdlod_quadtree_node *child = &stack[stack_size + pushed];
+
+        child->x = node.x + ((i == 1 || i == 2) ? quarter : -quarter);
+        child->z = node.z + ((i >= 2) ? quarter : -quarter);
+        child->size = half;
+        child->lod = node.lod - 1;
+
+        if (!cdlod_frame_culled(frame, child, root_bounds))
+        {
+          stack_views[stack_size + pushed] = split_views;
+          pushed++;
+        }
+      }
+
+      if (!root_bounds && pushed > 0)
+      {
+        float xs[4], zs[4];
+
+        for (i = 0; i < pushed; ++i)
+        {
+          xs[i] = stack[stack_size + i].x;
+          zs[i] = stack[stack_size + i].z;
+        }
+
+        cdlod_height_source_sample(&height, xs, zs, &stack_height[stack_size], pushed);
+      }
+
+      stack_size += pushed;
+    }
+    else
+    {
+      for (i = 0; i < view_count; ++i)
+      {
+        if (split_views & (1UL << i))
+        {
+          views[i].result.status |= CDLOD_STATUS_STACK_FULL;
+        }
+      }
+    }
+  }
+}
+
+/* traverse the root grids of all views in one pass. every root of the union
+ * of all grids is visited once for the views whose grid contains it. returns
+ * the combined result of all views, the result of every view is stored in the
+ * view. more than CDLOD_MAX_VIEWS views return CDLOD_STATUS_INVALID without
+ * touching any view.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frame_traverse_views(
+    cdlod_frame *frame, cdlod_view *views, int view_count)
+{
+  cdlod_quadtree_node root;
+  cdlod_result result;
+  int radius = frame->grid_radius;
+  int min_x, min_z, max_x, max_z;
+  int gx, gz, i;
+
+  result.status = CDLOD_STATUS_OK;
+  result.vertices_required = 0;
+  result.indices_required = 0;
+  result.nodes_required = 0;
+
+  if (view_count <= 0)
+  {
+    return result;
+  }
+
+  if (view_count > CDLOD_MAX_VIEWS)
+  {
+    result.status = CDLOD_STATUS_INVALID;
+    return result;
+  }
+
+  min_x = max_x = views[0].grid_center_x;
+  min_z = max_z = views[0].grid_center_z;
+
+  for (i = 0; i < view_count; ++i)
+  {
+    cdlod_view *view = &views[i];
+
+    view->vertices_count = 0;
+    view->indices_count = 0;
+    view->nodes_count = 0;
+
+    view->result.status = CDLOD_STATUS_OK;
+    view->result.vertices_required = 0;
+    view->result.indices_required = 0;
+    view->result.nodes_required = 0;
+
+    min_x = view->grid_center_x < min_x ? view->grid_center_x : min_x;
+    max_x = view->grid_center_x > max_x ? view->grid_center_x : max_x;
+    min_z = view->grid_center_z < min_z ? view->grid_center_z : min_z;
+    max_z = view->grid_center_z > max_z ? view->grid_center_z : max_z;
+  }
+
+  /* same root order as cdlod_frame_traverse() for every view */
+  for (gx = min_x - radius; gx <= max_x + radius; ++gx)
+  {
+    for (gz = min_z - radius; gz <= max_z + radius; ++gz)
+    {
+      unsigned long root_views = 0;
+
+      for (i = 0; i < view_count; ++i)
+      {
+        int dx = gx - views[i].grid_center_x;
+        int dz = gz - views[i].grid_center_z;
+
+        if (dx >= -radius && dx <= radius && dz >= -radius && dz <= radius)
+        {
+          root_views |= 1UL << i;
+        }
+      }
+
+      if (!root_views)
+      {
+        continue;
+      }
+
+      root.x = (float)gx * frame->patch_size + frame->patch_size * 0.5f;
+      root.z = (float)gz * frame->patch_size + frame->patch_size * 0.5f;
+      root.size = frame->patch_size;
+      root.lod = frame->lod_count - 1;
+
+      cdlod_quadtree_traverse_views(frame, root, root_views, views, view_count);
+    }
+  }
+
+  for (i = 0; i < view_count; ++i)
+  {
+    result.status |= views[i].result.status;
+    result.vertices_required += views[i].result.vertices_required;
+    result.indices_required += views[i].result.indices_required;
+    result.nodes_required += views[i].result.nodes_required;
+  }
+
+  return result;
+}
+
+/* incremental selection
+ *
+ * keeps the selected nodes of the previous update in stable slots and reports
+ * which slots were added and removed. geometry is written per slot into a
+ * caller owned pool (slot * patch size), so only added slots have to be
+ * uploaded again. a slot is never reused in the update that freed it.
+ *
+ * patch geometry is only generated when a node is added, so use
+ * CDLOD_MORPH_NONE and morph in the shader from the node descriptor instead
+ * of camera dependent vertex morphing.
+ */
+typedef struct cdlod_selection
+{
+  int capacity;   /* number of slots */
+  int table_size; /* hash table entries (power of two) */
+  int update;     /* update counter */
+  int count;      /* slots in use */
+
+  cdlod_node *nodes;   /* [capacity] node of every slot, followed by [capacity] scratch nodes */
+  int *keys;           /* [capacity * 3] node key of every slot */
+  int *slot_update;    /* [capacity] last update the slot was selected in, -1 = free */
+  int *table;          /* [table_size] slot + 1 per entry, 0 = empty */
+  int *free_slots;     /* [capacity] */
+  int free_count;
+
+  int *added;          /* [capacity] slots added by the last update */
+  int added_count;
+  int *removed;        /* [capacity] slots removed by the last update */
+  int removed_count;
+
+} cdlod_selection;
+
+/* number of ints required for the selection data (nodes need 2 * capacity) */
+CDLOD_API CDLOD_INLINE int cdlod_selection_memory_size(int capacity)
+{
+  return capacity * 3 + capacity * 4 + cdlod_node_table_size(capacity);
+}
+
+/* returns 0 if data is too small */
+CDLOD_API CDLOD_INLINE int cdlod_selection_init(
+    cdlod_selection *selection,
+    cdlod_node *nodes, int *data, int data_capacity,
+    int capacity)
+{
+  int i;
+
+  if (capacity < 1 || cdlod_selection_memory_size(capacity) > data_capacity)
+  {
+    return 0;
+  }
+
+  selection->capacity = capacity;
+  selection->table_size = cdlod_node_table_size(capacity);
+  selection->update = 0;
+  selection->count = 0;
+
+  selection->nodes = nodes;
+  selection->keys = data;
+  selection->slot_update = selection->keys + capacity * 3;
+  selection->free_slots = selection->slot_update + capacity;
+  selection->added = selection->free_slots + capacity;
+  selection->removed = selection->added + capacity;
+  selection->table = selection->removed + capacity;
+
+  selection->free_count = capacity;
+  selection->added_count = 0;
+  selection->removed_count = 0;
+
+  for (i = 0; i < capacity; ++i)
+  {
+    selection->slot_update[i] = -1;
+    selection->free_slots[i] = capacity - 1 - i; /* lowest slots first */
+  }
+
+  for (i = 0; i < selection->table_size; ++i)
+  {
+    selection->table[i] = 0;
+  }
+
+  return 1;
+}
+
+/* returns the table entry of key (empty if not present) */
+CDLOD_API CDLOD_INLINE int *cdlod_selection_find(cdlod_selection *selection, cdlod_node_key key)
+{
+  unsigned int mask = (unsigned int)selection->table_size - 1u;
+  unsigned int i = cdlod_node_key_hash(key) & mask;
+
+  for (;;)
+  {
+    int *entry = &selection->table[i];
+    int *k;
+
+    if (*entry == 0)
+    {
+      return entry;
+    }
+
+    k = &selection->keys[(*entry - 1) * 3];
+
+    if (k[0] == key.x && k[1] == key.z && k[2] == key.lod)
+    {
+      return entry;
+    }
+
+    i = (i + 1u) & mask;
+  }
+}
+
+/* select the nodes for frame and diff them against the previous update.
+ * if vertices/indices are set the geometry of every added slot is generated
+ * into the pools (see cdlod_frame_patch_size for the size per slot).
+ * CDLOD_STATUS_NODES_FULL is set if not all nodes found a free slot.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_selection_update(
+    cdlod_selection *selection, cdlod_frame *frame,
+    float *vertices, int *indices)
+{
+  cdlod_node *selected = selection->nodes + selection->capacity;
+  int selected_count = 0;
+  int patch_vertices, patch_indices;
+  int update = ++selection->update;
+  cdlod_result result;
+  int i;
+
+  result = cdlod_frame_traverse(frame,
+                                0, 0, 0,
+                                0, 0, 0,
+                                selected, selection->capacity, &selected_count);
+
+  selection->added_count = 0;
+  selection->removed_count = 0;
+
+  /* keep known nodes, assign free slots to new ones */
+  for (i = 0; i < selected_count; ++i)
+  {
+    cdlod_node_key key = cdlod_node_key_of(&selected[i]);
+    int *entry = cdlod_selection_find(selection, key);
+    int slot;
+
+    if (*entry)
+    {
+      slot = *entry - 1;
+      selection->slot_update[slot] = update;
+
+      /* a neighbour changed the stitched seams or the lod settings changed
+       * the morph range: emit the patch again
+       */
+      if (selection->nodes[slot].seams != selected[i].seams ||
+          selection->nodes[slot].morph_start != selected[i].morph_start ||
+          selection->nodes[slot].morph_end != selected[i].morph_end)
+      {
+        selection->nodes[slot] = selected[i];
+        selection->added[selection->added_count++] = slot;
+      }
+      continue;
+    }
+
+    if (selection->free_count == 0)
+    {
+      result.status |= CDLOD_STATUS_NODES_FULL;
+      continue;
+    }
+
+    slot = selection->free_slots[--selection->free_count];
+
+    selection->nodes[slot] = selected[i];
+    selection->keys[slot * 3 + 0] = key.x;
+    selection->keys[slot * 3 + 1] = key.z;
+    selection->keys[slot * 3 + 2] = key.lod;
+    selection->slot_update[slot] = update;
+    selection->added[selection->added_count++] = slot;
+
+    *entry = slot + 1;
+  }
+
+  /* free the slots of nodes that are no longer selected */
+  for (i = 0; i < selection->capacity; ++i)
+  {
+    if (selection->slot_update[i] >= 0 && selection->slot_update[i] != update)
+    {
+      selection->slot_update[i] = -1;
+      selection->removed[selection->removed_count++] = i;
+    }
+  }
+
+  for (i = 0; i < selection->removed_count; ++i)
+  {
+    selection->free_slots[selection->free_count++] = selection->removed[i];
+  }
+
+  selection->count = selection->capacity - selection->free_count;
+
+  /* drop the table entries of the removed slots (their keys are still set) */
+  for (i = 0; i < selection->removed_count; ++i)
+  {
+    int slot = selection->removed[i];
+    cdlod_node_key key;
+
+    key.x = selection->keys[slot * 3 + 0];
+    key.z = selection->keys[slot * 3 + 1];
+    key.lod = selection->keys[slot * 3 + 2];
+
+    cdlod_node_table_remove(selection->table, selection->table_size, selection->keys,
+                            (int)(cdlod_selection_find(selection, key) - selection->table));
+  }
+
+  if (!vertices)
+  {
+    return result;
+  }
+
+  cdlod_frame_patch_size(frame, &patch_vertices, &patch_indices);
+
+  for (i = 0; i < selection->added_count; ++i)
+  {
+    int slot = selection->added[i];
+    cdlod_node *node = &selection->nodes[slot];
+    cdlod_quadtree_node quadtree_node;
+    int vertices_count = slot * patch_vertices;
+    int indices_count = slot * patch_indices;
+
+    quadtree_node.x = node->x;
+    quadtree_node.z = node->z;
+    quadtree_node.size = node->size;
+    quadtree_node.lod = node->lod;
+
+    cdlod_frame_generate(frame, &quadtree_node, node, &frame->height,
+                         frame->camera_x, frame->camera_y, frame->camera_z,
+                         vertices, vertices_count + patch_vertices, &vertices_count,
+                         indices, indices_count + patch_indices, &indices_count);
+
+    /* stitched patches use fewer indices, pad the slot with degenerate triangles */
+    while (indices_count < (slot + 1) * patch_indices)
+    {
+      indices[indices_count++] = slot * patch_vertices / cdlod_frame_vertex_stride(frame);
+    }
+  }
+
+  return result;
+}
+
+/* same as cdlod() but every selected node emits a patch_resolution x patch_resolution
+ * shared vertex grid (e.g. 17 or 33) with indexed triangles and one skirt ring.
+ * a patch_resolution below 2 falls back to the single quad patches of cdlod().
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_grid(
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z,
+    cdlod_height_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius,
+    float skirt_depth,
+    int patch_resolution)
+{
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   camera_x, camera_y, camera_z,
+                   forward_x, forward_z,
+                   height, patch_size,
+                   lod_count, lod_ranges,
+                   grid_radius);
+
+  frame.skirt_depth = skirt_depth;
+  frame.patch_resolution = patch_resolution;
+
+  return cdlod_frame_traverse(&frame,
+                              vertices, vertices_capacity, vertices_count,
+                              indices, indices_capacity, indices_count,
+                              0, 0, 0);
+}
+
+CDLOD_API CDLOD_INLINE cdlod_result cdlod(
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z,
+    cdlod_height_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius,
+    float skirt_depth)
+{
+  return cdlod_grid(vertices, vertices_capacity, vertices_count,
+                    indices, indices_capacity, indices_count,
+                    camera_x, camera_y, camera_z,
+                    forward_x, forward_z,
+                    height, patch_size,
+                    lod_count, lod_ranges,
+                    grid_radius, skirt_depth,
+                    0);
+}
+
+/* same as cdlod() but skips every node (and its whole subtree) whose bounding
+ * box lies outside the view frustum. frustum_planes holds 6 * (a, b, c, d)
+ * planes (see cdlod_frustum_from_matrix), height_min/height_max bound the
+ * terrain height.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_frustum(
+    float *vertices, int vertices_capacity, int *vertices_count,
+    int *indices, int indices_capacity, int *indices_count,
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z,
+    cdlod_height_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius,
+    float skirt_depth,
+    float *frustum_planes,
+    float height_min, float height_max)
+{
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   camera_x, camera_y, camera_z,
+                   forward_x, forward_z,
+                   height, patch_size,
+                   lod_count, lod_ranges,
+                   grid_radius);
+
+  frame.skirt_depth = skirt_depth;
+  cdlod_frame_set_frustum(&frame, frustum_planes, height_min, height_max);
+
+  return cdlod_frame_traverse(&frame,
+                              vertices, vertices_capacity, vertices_count,
+                              indices, indices_capacity, indices_count,
+                              0, 0, 0);
+}
+
+/* instanced rendering output: runs the same selection as cdlod() but only writes
+ * one cdlod_node descriptor per selected node instead of expanded geometry.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_select(
+    cdlod_node *nodes, int nodes_capacity, int *nodes_count,
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z,
+    cdlod_height_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius)
+{
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   camera_x, camera_y, camera_z,
+                   forward_x, forward_z,
+                   height, patch_size,
+                   lod_count, lod_ranges,
+                   grid_radius);
+
+  return cdlod_frame_traverse(&frame,
+                              0, 0, 0,
+                              0, 0, 0,
+                              nodes, nodes_capacity, nodes_count);
+}
+
+/* count only pass for cdlod() / cdlod_grid(): runs the selection without writing
+ * anything and returns the exact vertices/indices capacity needed for the frame.
+ */
+CDLOD_API CDLOD_INLINE cdlod_result cdlod_count(
+    float camera_x, float camera_y, float camera_z,
+    float forward_x, float forward_z,
+    cdlod_height_function height,
+    float patch_size,
+    int lod_count,
+    float *lod_ranges,
+    int grid_radius,
+    int patch_resolution)
+{
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   camera_x, camera_y, camera_z,
+                   forward_x, forward_z,
+                   height, patch_size,
+                   lod_count, lod_ranges,
+                   grid_radius);
+
+  frame.patch_resolution = patch_resolution;
+
+  return cdlod_frame_traverse(&frame,
+                              0, 0, 0,
+                              0, 0, 0,
+                              0, 0, 0);
 }
 
 #endif /* CDLOD_H */
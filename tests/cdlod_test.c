@@ -25,6 +25,7 @@ static float custom_height_function(float x, float z)
 
 #define VERTICES_CAPACITY 10000
 #define INDICES_CAPACITY 10000
+#define NODES_CAPACITY 4096
 
 static void cdlod_test_simple(void)
 {
@@ -77,6 +78,3215 @@ static void cdlod_test_simple(void)
   assert(indices_count > 0);
 }
 
+static int height_calls = 0;
+
+static float counting_height_function(float x, float z)
+{
+  height_calls++;
+  return 0.0f * (x + z);
+}
+
+static void cdlod_test_grid_patch(void)
+{
+  float vertices[VERTICES_CAPACITY];
+  int indices[INDICES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int patch_resolution = 17;
+  int i;
+
+  cdlod_height_source counting_height;
+  cdlod_node node;
+
+  counting_height.function = counting_height_function;
+  counting_height.batch = 0;
+  counting_height.heightmap = 0;
+  counting_height.world = 0;
+
+  node.x = 32.0f;
+  node.z = 32.0f;
+  node.size = 64.0f;
+  node.lod = 0;
+  node.morph_start = CDLOD_MORPH_DISABLED;
+  node.morph_end = CDLOD_MORPH_DISABLED * 2.0f;
+  node.seams = 0;
+
+  height_calls = 0;
+
+  cdlod_generate_grid_patch(
+      vertices, VERTICES_CAPACITY, &vertices_count,
+      indices, INDICES_CAPACITY, &indices_count,
+      &node, &counting_height, 10.0f, patch_resolution,
+      CDLOD_MORPH_NONE, 0.0f, 0.0f, 0.0f);
+
+  /* 17x17 shared grid vertices + 64 skirt ring vertices */
+  assert(vertices_count == (17 * 17 + 4 * 16) * 3);
+  assert(indices_count == (16 * 16 + 4 * 16) * 6);
+  assert(vertices_count == cdlod_grid_patch_vertex_count(patch_resolution) * 3);
+  assert(indices_count == cdlod_grid_patch_index_count(patch_resolution));
+
+  /* one height sample per shared vertex, skirts reuse border heights */
+  assert(height_calls == 17 * 17);
+
+  /* corners and skirt ring */
+  assert_equalsf(vertices[0], 0.0f, 0.0001f);
+  assert_equalsf(vertices[2], 0.0f, 0.0001f);
+  assert_equalsf(vertices[(17 * 17 - 1) * 3 + 0], 64.0f, 0.0001f);
+  assert_equalsf(vertices[(17 * 17 - 1) * 3 + 2], 64.0f, 0.0001f);
+  assert_equalsf(vertices[(17 * 17) * 3 + 1], -10.0f, 0.0001f);
+
+  for (i = 0; i < indices_count; ++i)
+  {
+    if (indices[i] < 0 || indices[i] >= vertices_count / 3)
+    {
+      break;
+    }
+  }
+  assert(i == indices_count);
+
+  /* not enough capacity leaves the buffers untouched */
+  vertices_count = VERTICES_CAPACITY - 3;
+  indices_count = 0;
+  cdlod_generate_grid_patch(
+      vertices, VERTICES_CAPACITY, &vertices_count,
+      indices, INDICES_CAPACITY, &indices_count,
+      &node, &counting_height, 10.0f, patch_resolution,
+      CDLOD_MORPH_NONE, 0.0f, 0.0f, 0.0f);
+  assert(vertices_count == VERTICES_CAPACITY - 3);
+  assert(indices_count == 0);
+}
+
+static float slope_height_function(float x, float z)
+{
+  return x * 0.25f + z * 0.5f;
+}
+
+static void cdlod_test_morph(void)
+{
+  float vertices[VERTICES_CAPACITY];
+  int indices[INDICES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int patch_resolution = 5;
+  float *v;
+  int i;
+
+  cdlod_height_source slope_height;
+  cdlod_node node;
+
+  slope_height.function = slope_height_function;
+  slope_height.batch = 0;
+  slope_height.heightmap = 0;
+  slope_height.world = 0;
+
+  node.x = 8.0f;
+  node.z = 8.0f;
+  node.size = 16.0f;
+  node.lod = 0;
+  node.morph_start = 100.0f;
+  node.morph_end = 200.0f;
+  node.seams = 0;
+
+  /* camera inside the morph start distance: positions are untouched */
+  cdlod_generate_grid_patch(
+      vertices, VERTICES_CAPACITY, &vertices_count,
+      indices, INDICES_CAPACITY, &indices_count,
+      &node, &slope_height, 1.0f, patch_resolution,
+      CDLOD_MORPH_POSITION, 0.0f, 0.0f, 0.0f);
+
+  v = vertices + (0 * 5 + 1) * 3; /* x = 1, z = 0 */
+  assert_equalsf(v[0], 4.0f, 0.0001f);
+  assert_equalsf(v[1], 1.0f, 0.0001f);
+
+  /* camera beyond the morph end distance: odd vertices collapse onto even ones */
+  vertices_count = 0;
+  indices_count = 0;
+  cdlod_generate_grid_patch(
+      vertices, VERTICES_CAPACITY, &vertices_count,
+      indices, INDICES_CAPACITY, &indices_count,
+      &node, &slope_height, 1.0f, patch_resolution,
+      CDLOD_MORPH_POSITION, 1000.0f, 0.0f, 0.0f);
+
+  v = vertices + (0 * 5 + 1) * 3; /* x = 1, z = 0 -> x = 0, z = 0 */
+  assert_equalsf(v[0], 0.0f, 0.0001f);
+  assert_equalsf(v[1], 0.0f, 0.0001f);
+  assert_equalsf(v[2], 0.0f, 0.0001f);
+
+  v = vertices + (3 * 5 + 3) * 3; /* x = 3, z = 3 -> x = 2, z = 2 */
+  assert_equalsf(v[0], 8.0f, 0.0001f);
+  assert_equalsf(v[1], 6.0f, 0.0001f);
+  assert_equalsf(v[2], 8.0f, 0.0001f);
+
+  v = vertices + (4 * 5 + 4) * 3; /* even vertices never move */
+  assert_equalsf(v[0], 16.0f, 0.0001f);
+  assert_equalsf(v[2], 16.0f, 0.0001f);
+
+  /* halfway through the morph range */
+  vertices_count = 0;
+  indices_count = 0;
+  cdlod_generate_grid_patch(
+      vertices, VERTICES_CAPACITY, &vertices_count,
+      indices, INDICES_CAPACITY, &indices_count,
+      &node, &slope_height, 1.0f, patch_resolution,
+      CDLOD_MORPH_FACTOR, 4.0f + 150.0f, 0.0f, 0.0f);
+
+  /* morph factor output: 4 floats per vertex, skirts copy their border factor */
+  assert(vertices_count == cdlod_grid_patch_vertex_count(patch_resolution) * 4);
+  v = vertices + (0 * 5 + 1) * 4;
+  assert_equalsf(v[0], 4.0f, 0.0001f);
+  assert_equalsf(v[3], 0.5f, 0.01f);
+  assert_equalsf(vertices[(5 * 5) * 4 + 3], vertices[3], 0.0001f);
+
+  for (i = 0; i < indices_count; ++i)
+  {
+    if (indices[i] < 0 || indices[i] >= vertices_count / 4)
+    {
+      break;
+    }
+  }
+  assert(i == indices_count);
+}
+
+static void cdlod_test_morph_frame(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int morphing = 0;
+  int morph_vertices_count;
+  int i;
+
+  float lod_ranges[] = {0.0f, 64.0f, 160.0f};
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   3, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 9;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+
+  assert(vertices_count > 0 && vertices_count % (cdlod_grid_patch_vertex_count(9) * 4) == 0);
+
+  for (i = 0; i < vertices_count; i += 4)
+  {
+    if (vertices[i + 3] < 0.0f || vertices[i + 3] > 1.0f)
+    {
+      break;
+    }
+
+    morphing += (vertices[i + 3] > 0.0f && vertices[i + 3] < 1.0f);
+  }
+  assert(i == vertices_count);
+  assert(morphing > 0);
+
+  /* morphing selects by the distance to the node box, unmorphed patches keep
+   * the (smaller) selection by the distance to the node center
+   */
+  morph_vertices_count = vertices_count / 4;
+  frame.morph_mode = CDLOD_MORPH_NONE;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+  assert(vertices_count > 0 && vertices_count / 3 < morph_vertices_count);
+}
+
+static void cdlod_test_frustum_culling(void)
+{
+  static float vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int all_vertices_count;
+  int all_height_calls;
+  int culled_height_calls;
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f, 400.0f};
+  float view_projection[16] = {0};
+  float planes[6 * 4];
+
+  /* camera at (0, 10, 0) looking down -Z, 90 degree fov, aspect 1, near 0.1, far 1000 */
+  float near_plane = 0.1f;
+  float far_plane = 1000.0f;
+  view_projection[0] = 1.0f;
+  view_projection[5] = 1.0f;
+  view_projection[10] = (far_plane + near_plane) / (near_plane - far_plane);
+  view_projection[11] = -1.0f;
+  view_projection[13] = -10.0f;
+  view_projection[14] = 2.0f * far_plane * near_plane / (near_plane - far_plane);
+
+  cdlod_frustum_from_matrix(planes, view_projection);
+
+  /* box in front of / behind the camera */
+  assert(!cdlod_frustum_cull_box(planes, -1.0f, 0.0f, -20.0f, 1.0f, 1.0f, -10.0f));
+  assert(cdlod_frustum_cull_box(planes, -1.0f, 0.0f, 10.0f, 1.0f, 1.0f, 20.0f));
+
+  height_calls = 0;
+  cdlod(vertices, VERTICES_CAPACITY * 32, &vertices_count,
+        indices, INDICES_CAPACITY * 32, &indices_count,
+        0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+        counting_height_function, 64.0f,
+        5, lod_ranges, 9, 10.0f);
+  all_vertices_count = vertices_count;
+  all_height_calls = height_calls;
+
+  height_calls = 0;
+  cdlod_frustum(vertices, VERTICES_CAPACITY * 32, &vertices_count,
+                indices, INDICES_CAPACITY * 32, &indices_count,
+                0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                counting_height_function, 64.0f,
+                5, lod_ranges, 9, 10.0f,
+                planes, 0.0f, 0.0f);
+  culled_height_calls = height_calls;
+
+  test_print_string("  frustum culling vertices: ");
+  test_print_int(vertices_count / 3);
+  test_print_string(" / ");
+  test_print_int(all_vertices_count / 3);
+  test_print_string(", height calls: ");
+  test_print_int(culled_height_calls);
+  test_print_string(" / ");
+  test_print_int(all_height_calls);
+  test_print_string("\n");
+
+  assert(all_vertices_count < VERTICES_CAPACITY * 32);
+  assert(vertices_count > 0);
+  assert(vertices_count * 2 < all_vertices_count);
+  assert(culled_height_calls * 2 < all_height_calls);
+
+  /* nothing behind the camera (all patch corners have z <= 0 within one patch) */
+  for (i = 0; i < vertices_count; i += 3)
+  {
+    if (vertices[i + 2] > 64.0f)
+    {
+      break;
+    }
+  }
+  assert(i == vertices_count);
+}
+
+static float bump_height = 0.0f;
+
+static float bump_height_function(float x, float z)
+{
+  height_calls++;
+  return (x >= 0.0f && x <= 16.0f && z >= 0.0f && z <= 16.0f) ? bump_height : slope_height_function(x, z);
+}
+
+static void cdlod_test_height_pyramid(void)
+{
+  static float pyramid_data[4096];
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int traversal_height_calls;
+  float height_min, height_max;
+
+  float lod_ranges[] = {0.0f, 40.0f, 80.0f};
+  cdlod_height_source bump_source;
+  cdlod_height_pyramid pyramid;
+  cdlod_frame frame;
+
+  bump_source.function = bump_height_function;
+  bump_source.batch = 0;
+  bump_source.heightmap = 0;
+  bump_source.world = 0;
+
+  /* 4x4 root patches of size 64 starting at root (-2, -2) => [-128, 128) */
+  assert(cdlod_height_pyramid_memory_size(4, 4, 3) == (16 * 16 + 8 * 8 + 4 * 4) * 2);
+  assert(!cdlod_height_pyramid_init(&pyramid, pyramid_data, 16, -2, -2, 4, 4, 64.0f, 3, 2));
+  assert(cdlod_height_pyramid_init(&pyramid, pyramid_data, 4096, -2, -2, 4, 4, 64.0f, 3, 2));
+
+  bump_height = 0.0f;
+  cdlod_height_pyramid_build(&pyramid, &bump_source);
+
+  /* finest node [32, 48] x [0, 16] */
+  assert(cdlod_height_pyramid_query(&pyramid, 0, 40.0f, 8.0f, &height_min, &height_max));
+  assert_equalsf(height_min, 8.0f, 0.0001f);
+  assert_equalsf(height_max, 20.0f, 0.0001f);
+
+  /* root node [0, 64] x [0, 64] covers the flat bump */
+  assert(cdlod_height_pyramid_query(&pyramid, 2, 32.0f, 32.0f, &height_min, &height_max));
+  assert_equalsf(height_min, 0.0f, 0.0001f);
+  assert_equalsf(height_max, 48.0f, 0.0001f);
+
+  /* outside of the covered area */
+  assert(!cdlod_height_pyramid_query(&pyramid, 0, 200.0f, 8.0f, &height_min, &height_max));
+  assert(!cdlod_height_pyramid_query(&pyramid, 0, -200.0f, 8.0f, &height_min, &height_max));
+
+  /* raise the bump and refit only the affected nodes */
+  bump_height = 100.0f;
+  height_calls = 0;
+  cdlod_height_pyramid_refit(&pyramid, &bump_source, 0.0f, 0.0f, 16.0f, 16.0f);
+  assert(height_calls == 9 * 4); /* 3x3 touched finest nodes, 4 samples each */
+
+  assert(cdlod_height_pyramid_query(&pyramid, 0, 8.0f, 8.0f, &height_min, &height_max));
+  assert_equalsf(height_max, 100.0f, 0.0001f);
+
+  /* neighbour [-16, 0] x [0, 16] shares the border at x = 0 */
+  assert(cdlod_height_pyramid_query(&pyramid, 0, -8.0f, 8.0f, &height_min, &height_max));
+  assert_equalsf(height_max, 100.0f, 0.0001f);
+  assert(cdlod_height_pyramid_query(&pyramid, 2, 32.0f, 32.0f, &height_min, &height_max));
+  assert_equalsf(height_max, 100.0f, 0.0001f);
+  assert(cdlod_height_pyramid_query(&pyramid, 0, -120.0f, -120.0f, &height_min, &height_max));
+  assert_equalsf(height_max, -112.0f * 0.25f + -112.0f * 0.5f, 0.0001f);
+
+  /* traversal over the covered area only samples heights for the emitted patches */
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, 0.0f,
+                   bump_height_function, 64.0f,
+                   3, lod_ranges, 1);
+  frame.height_pyramid = &pyramid;
+
+  height_calls = 0;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+  traversal_height_calls = height_calls;
+  nodes_count = vertices_count / (12 * 3);
+
+  assert(nodes_count > 0);
+  assert(traversal_height_calls == nodes_count * 4);
+}
+
+static void cdlod_test_result(void)
+{
+  static float vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  cdlod_node nodes[16];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f, 400.0f};
+  cdlod_result count;
+  cdlod_result frame_result;
+
+  /* count only pass */
+  count = cdlod_count(0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                      custom_height_function, 64.0f,
+                      5, lod_ranges, 9, 0);
+
+  assert(count.status == CDLOD_STATUS_OK);
+  assert(count.nodes_required > 0);
+  assert(count.vertices_required == count.nodes_required * 12 * 3);
+  assert(count.indices_required == count.nodes_required * 30);
+
+  /* too small buffers are reported together with the full frame size */
+  frame_result = cdlod(vertices, VERTICES_CAPACITY, &vertices_count,
+                 indices, INDICES_CAPACITY * 32, &indices_count,
+                 0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                 custom_height_function, 64.0f,
+                 5, lod_ranges, 9, 10.0f);
+
+  assert(frame_result.status == CDLOD_STATUS_VERTICES_FULL);
+  assert(frame_result.vertices_required == count.vertices_required);
+  assert(frame_result.indices_required == count.indices_required);
+  assert(vertices_count <= VERTICES_CAPACITY);
+
+  /* exactly sized buffers hold the complete frame */
+  assert(count.vertices_required <= VERTICES_CAPACITY * 32);
+  assert(count.indices_required <= INDICES_CAPACITY * 32);
+
+  frame_result = cdlod(vertices, count.vertices_required, &vertices_count,
+                 indices, count.indices_required, &indices_count,
+                 0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                 custom_height_function, 64.0f,
+                 5, lod_ranges, 9, 10.0f);
+
+  assert(frame_result.status == CDLOD_STATUS_OK);
+  assert(vertices_count == count.vertices_required);
+  assert(indices_count == count.indices_required);
+
+  /* grid patches */
+  count = cdlod_count(0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                      custom_height_function, 64.0f,
+                      3, lod_ranges, 2, 9);
+  assert(count.vertices_required == count.nodes_required * cdlod_grid_patch_vertex_count(9) * 3);
+  assert(count.indices_required == count.nodes_required * cdlod_grid_patch_index_count(9));
+
+  /* node descriptors */
+  frame_result = cdlod_select(nodes, 16, &nodes_count,
+                        0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                        custom_height_function, 64.0f,
+                        5, lod_ranges, 9);
+  assert(frame_result.status == CDLOD_STATUS_NODES_FULL);
+  assert(nodes_count == 16);
+  assert(frame_result.nodes_required > 16);
+}
+
+static void cdlod_test_grid_vertex_savings(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  int quad_vertices_count = 0;
+  int quad_indices_count = 0;
+  int quad_height_calls;
+  int grid_vertices_count = 0;
+  int grid_indices_count = 0;
+  int grid_height_calls;
+
+  /* same finest triangle size (4 units) for both: 5 lods of single quads vs.
+   * 3 lods of 5x5 vertex grids (4 quads per side)
+   */
+  float quad_lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f, 400.0f};
+  float grid_lod_ranges[] = {0.0f, 100.0f, 400.0f};
+
+  height_calls = 0;
+  cdlod(vertices, VERTICES_CAPACITY * 8, &quad_vertices_count,
+        indices, INDICES_CAPACITY * 8, &quad_indices_count,
+        0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+        counting_height_function, 64.0f,
+        5, quad_lod_ranges, 2, 10.0f);
+  quad_height_calls = height_calls;
+
+  height_calls = 0;
+  cdlod_grid(vertices, VERTICES_CAPACITY * 8, &grid_vertices_count,
+             indices, INDICES_CAPACITY * 8, &grid_indices_count,
+             0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+             counting_height_function, 64.0f,
+             3, grid_lod_ranges, 2, 10.0f, 5);
+  grid_height_calls = height_calls;
+
+  test_print_string("  quad vertices: ");
+  test_print_int(quad_vertices_count / 3);
+  test_print_string(", height calls: ");
+  test_print_int(quad_height_calls);
+  test_print_string("\n");
+
+  test_print_string("  grid vertices: ");
+  test_print_int(grid_vertices_count / 3);
+  test_print_string(", height calls: ");
+  test_print_int(grid_height_calls);
+  test_print_string("\n");
+
+  assert(quad_vertices_count > 0 && quad_vertices_count < VERTICES_CAPACITY * 8);
+  assert(grid_vertices_count > 0 && grid_vertices_count < VERTICES_CAPACITY * 8);
+  assert(grid_vertices_count < quad_vertices_count);
+  assert(grid_height_calls < quad_height_calls);
+}
+
+static int height_batch_calls = 0;
+
+static void counting_height_batch_function(const float *xs, const float *zs, float *out, int n)
+{
+  int i;
+
+  height_batch_calls++;
+
+  for (i = 0; i < n; ++i)
+  {
+    out[i] = counting_height_function(xs[i], zs[i]);
+  }
+}
+
+static void cdlod_test_height_batch(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float batch_vertices[VERTICES_CAPACITY * 8];
+  static int batch_indices[INDICES_CAPACITY * 8];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int batch_vertices_count = 0;
+  int batch_indices_count = 0;
+  int point_calls;
+  int resolution;
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_frame frame;
+
+  /* single quads (0) and shared-vertex grids (9) produce the same output per
+   * point and in batches, with far fewer callback invocations
+   */
+  for (resolution = 0; resolution <= 9; resolution += 9)
+  {
+    cdlod_frame_init(&frame,
+                     0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                     counting_height_function, 64.0f,
+                     4, lod_ranges, 2);
+    frame.skirt_depth = 10.0f;
+    frame.patch_resolution = resolution;
+    frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+    height_calls = 0;
+    cdlod_frame_traverse(&frame,
+                         vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                         indices, INDICES_CAPACITY * 8, &indices_count,
+                         0, 0, 0);
+    point_calls = height_calls;
+
+    frame.height.batch = counting_height_batch_function;
+
+    height_calls = 0;
+    height_batch_calls = 0;
+    cdlod_frame_traverse(&frame,
+                         batch_vertices, VERTICES_CAPACITY * 8, &batch_vertices_count,
+                         batch_indices, INDICES_CAPACITY * 8, &batch_indices_count,
+                         0, 0, 0);
+
+    test_print_string("  height points: ");
+    test_print_int(height_calls);
+    test_print_string(", batch calls: ");
+    test_print_int(height_batch_calls);
+    test_print_string("\n");
+
+    assert(vertices_count > 0 && vertices_count == batch_vertices_count);
+    assert(indices_count > 0 && indices_count == batch_indices_count);
+    assert(height_calls == point_calls);
+    assert(height_batch_calls * 3 < height_calls);
+
+    for (i = 0; i < vertices_count; ++i)
+    {
+      if (vertices[i] != batch_vertices[i])
+      {
+        break;
+      }
+    }
+    assert(i == vertices_count);
+
+    for (i = 0; i < indices_count; ++i)
+    {
+      if (indices[i] != batch_indices[i])
+      {
+        break;
+      }
+    }
+    assert(i == indices_count);
+  }
+}
+
+/* matches the test heightmap below: 5x5 samples of value x * 100 + z * 10
+ * spaced 64 units apart starting at (-128, -128), scaled by 0.01
+ */
+static float linear_height_function(float x, float z)
+{
+  return (x + 128.0f) / 64.0f + (z + 128.0f) / 64.0f * 0.1f;
+}
+
+static void cdlod_test_heightmap(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float map_vertices[VERTICES_CAPACITY * 8];
+  static int map_indices[INDICES_CAPACITY * 8];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int map_vertices_count = 0;
+  int map_indices_count = 0;
+  unsigned short data16[5 * 5];
+  float data32[5 * 5];
+  float xs[4] = {-128.0f, 0.0f, 32.0f, 1000.0f};
+  float zs[4] = {-128.0f, 0.0f, -96.0f, -1000.0f};
+  float hs[4];
+  float pyramid_data[64];
+  float height_min, height_max;
+  int x, z, i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f};
+  cdlod_heightmap map;
+  cdlod_height_pyramid pyramid;
+  cdlod_frame frame;
+
+  for (z = 0; z < 5; ++z)
+  {
+    for (x = 0; x < 5; ++x)
+    {
+      data16[z * 5 + x] = (unsigned short)(x * 100 + z * 10);
+      data32[z * 5 + x] = (float)(x * 100 + z * 10);
+    }
+  }
+
+  map.width = 5;
+  map.height = 5;
+  map.origin_x = -128.0f;
+  map.origin_z = -128.0f;
+  map.scale = 64.0f;
+  map.height_scale = 0.01f;
+  map.height_offset = 0.0f;
+  map.data16 = data16;
+  map.data32 = 0;
+
+  /* exact on samples, bilinear in between, clamped outside */
+  cdlod_heightmap_sample(&map, xs, zs, hs, 4);
+  assert_equalsf(hs[0], 0.0f, 0.0001f);
+  assert_equalsf(hs[1], 2.2f, 0.0001f);
+  assert_equalsf(hs[2], 2.55f, 0.0001f);
+  assert_equalsf(hs[3], 4.0f, 0.0001f);
+
+  map.data16 = 0;
+  map.data32 = data32;
+  cdlod_heightmap_sample(&map, xs, zs, hs, 4);
+  assert_equalsf(hs[2], 2.55f, 0.0001f);
+  assert_equalsf(hs[3], 4.0f, 0.0001f);
+
+  /* the frame samples the heightmap instead of the callback */
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, 0.0f,
+                   linear_height_function, 64.0f,
+                   3, lod_ranges, 1);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+
+  map.data16 = data16;
+  map.data32 = 0;
+  frame.height.function = 0;
+  frame.height.heightmap = &map;
+
+  cdlod_frame_traverse(&frame,
+                       map_vertices, VERTICES_CAPACITY * 8, &map_vertices_count,
+                       map_indices, INDICES_CAPACITY * 8, &map_indices_count,
+                       0, 0, 0);
+
+  assert(vertices_count > 0 && vertices_count == map_vertices_count);
+  assert(indices_count == map_indices_count);
+
+  for (i = 0; i < vertices_count; ++i)
+  {
+    if (test_absf(vertices[i] - map_vertices[i]) > 0.001f)
+    {
+      break;
+    }
+  }
+  assert(i == vertices_count);
+
+  /* the height pyramid samples the heightmap of the frame as well */
+  assert(cdlod_height_pyramid_init(&pyramid, pyramid_data, 64, 0, 0, 1, 1, 64.0f, 3, 2));
+  cdlod_height_pyramid_build(&pyramid, &frame.height);
+  assert(cdlod_height_pyramid_query(&pyramid, 2, 32.0f, 32.0f, &height_min, &height_max));
+  assert_equalsf(height_min, 2.2f, 0.0001f);
+  assert_equalsf(height_max, 3.3f, 0.0001f);
+}
+
+#define JOB_COUNT 4
+
+static void cdlod_test_jobs(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float merged_vertices[VERTICES_CAPACITY * 8];
+  static int merged_indices[INDICES_CAPACITY * 8];
+  static float job_vertices[JOB_COUNT][VERTICES_CAPACITY * 8];
+  static int job_indices[JOB_COUNT][INDICES_CAPACITY * 8];
+  static cdlod_node nodes[NODES_CAPACITY];
+  static cdlod_node merged_nodes[NODES_CAPACITY];
+  static cdlod_node job_nodes[JOB_COUNT][NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int merged_vertices_count = 0;
+  int merged_indices_count = 0;
+  int nodes_count = 0;
+  int merged_nodes_count = 0;
+  int roots = 0;
+  int bad_nodes = 0;
+  int bad_indices = 0;
+  int i, lod;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_frame frame;
+  cdlod_lod_range ranges[4];
+  cdlod_lod_range merged_ranges[4];
+  cdlod_patch_cache cache;
+  cdlod_job jobs[JOB_COUNT];
+  cdlod_result frame_result;
+  cdlod_result merge_result;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  frame_result = cdlod_frame_traverse(&frame,
+                                      vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                                      indices, INDICES_CAPACITY * 8, &indices_count,
+                                      0, 0, 0);
+
+  /* every root belongs to exactly one job */
+  cdlod_frame_jobs(&frame, jobs, JOB_COUNT);
+
+  for (i = 0; i < JOB_COUNT; ++i)
+  {
+    roots += jobs[i].root_end - jobs[i].root_begin;
+
+    jobs[i].vertices = job_vertices[i];
+    jobs[i].vertices_capacity = VERTICES_CAPACITY * 8;
+    jobs[i].indices = job_indices[i];
+    jobs[i].indices_capacity = INDICES_CAPACITY * 8;
+  }
+  assert(jobs[0].root_begin == 0);
+  assert(roots == cdlod_frame_root_count(&frame));
+
+  /* would run on worker threads */
+  for (i = JOB_COUNT - 1; i >= 0; --i)
+  {
+    cdlod_job_run(&frame, &jobs[i]);
+  }
+
+  merge_result = cdlod_jobs_merge(&frame, jobs, JOB_COUNT,
+                                  merged_vertices, VERTICES_CAPACITY * 8, &merged_vertices_count,
+                                  merged_indices, INDICES_CAPACITY * 8, &merged_indices_count,
+                                  0, 0, 0);
+
+  assert(merge_result.status == CDLOD_STATUS_OK);
+  assert(merge_result.vertices_required == frame_result.vertices_required);
+  assert(merged_vertices_count == vertices_count && merged_indices_count == indices_count);
+
+  for (i = 0; i < vertices_count; ++i)
+  {
+    if (vertices[i] != merged_vertices[i])
+    {
+      break;
+    }
+  }
+  assert(i == vertices_count);
+
+  for (i = 0; i < indices_count; ++i)
+  {
+    if (indices[i] != merged_indices[i])
+    {
+      break;
+    }
+  }
+  assert(i == indices_count);
+
+  /* too small final buffers are reported, not overrun */
+  merge_result = cdlod_jobs_merge(&frame, jobs, JOB_COUNT,
+                                  merged_vertices, 64, &merged_vertices_count,
+                                  merged_indices, INDICES_CAPACITY * 8, &merged_indices_count,
+                                  0, 0, 0);
+  assert(merge_result.status == CDLOD_STATUS_VERTICES_FULL);
+  assert(merged_vertices_count == 0);
+
+  /* a patch cache can not be shared between jobs */
+  frame.patch_cache = &cache;
+  cdlod_job_run(&frame, &jobs[0]);
+  assert(jobs[0].result.status == CDLOD_STATUS_INVALID);
+  frame.patch_cache = 0;
+
+  /* per lod output: the merged output is grouped by lod like cdlod_frame_traverse() */
+  frame.lod_output = ranges;
+  frame_result = cdlod_frame_traverse(&frame,
+                                      vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                                      indices, INDICES_CAPACITY * 8, &indices_count,
+                                      nodes, NODES_CAPACITY, &nodes_count);
+  assert(frame_result.status == CDLOD_STATUS_OK);
+
+  for (i = 0; i < JOB_COUNT; ++i)
+  {
+    jobs[i].nodes = job_nodes[i];
+    jobs[i].nodes_capacity = NODES_CAPACITY;
+    cdlod_job_run(&frame, &jobs[i]);
+  }
+
+  frame.lod_output = merged_ranges;
+  merge_result = cdlod_jobs_merge(&frame, jobs, JOB_COUNT,
+                                  merged_vertices, VERTICES_CAPACITY * 8, &merged_vertices_count,
+                                  merged_indices, INDICES_CAPACITY * 8, &merged_indices_count,
+                                  merged_nodes, NODES_CAPACITY, &merged_nodes_count);
+  assert(merge_result.status == CDLOD_STATUS_OK);
+  assert(merged_vertices_count == vertices_count && merged_nodes_count == nodes_count);
+
+  for (lod = 0; lod < 4; ++lod)
+  {
+    cdlod_lod_range *range = &merged_ranges[lod];
+
+    assert(range->vertices_offset == ranges[lod].vertices_offset && range->vertices_count == ranges[lod].vertices_count);
+    assert(range->indices_offset == ranges[lod].indices_offset && range->indices_count == ranges[lod].indices_count);
+    assert(range->nodes_offset == ranges[lod].nodes_offset && range->nodes_count == ranges[lod].nodes_count);
+
+    for (i = range->nodes_offset; i < range->nodes_offset + range->nodes_count; ++i)
+    {
+      bad_nodes += merged_nodes[i].lod != lod;
+    }
+
+    for (i = range->indices_offset; i < range->indices_offset + range->indices_count; ++i)
+    {
+      bad_indices += merged_indices[i] < range->vertices_offset / 4 ||
+                     merged_indices[i] >= (range->vertices_offset + range->vertices_count) / 4;
+    }
+  }
+  assert(bad_nodes == 0);
+  assert(bad_indices == 0);
+
+  /* geometry needs the node descriptors of the job as well */
+  jobs[0].nodes = 0;
+  cdlod_job_run(&frame, &jobs[0]);
+  assert(jobs[0].result.status == CDLOD_STATUS_INVALID);
+}
+
+#define VIEW_COUNT 3
+
+static void cdlod_test_views(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float view_vertices[VIEW_COUNT][VERTICES_CAPACITY * 8];
+  static int view_indices[VIEW_COUNT][INDICES_CAPACITY * 8];
+  static cdlod_node view_nodes[VIEW_COUNT][NODES_CAPACITY];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int separate_height_calls = 0;
+  int shared_height_calls;
+  int v, i;
+
+  /* two clients close to each other and one far away */
+  float cameras[VIEW_COUNT][3] = {{0.0f, 10.0f, 0.0f}, {8.0f, 12.0f, 20.0f}, {600.0f, 10.0f, -300.0f}};
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_frame frame;
+  cdlod_view views[VIEW_COUNT];
+  cdlod_result views_result;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
+                   counting_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  for (v = 0; v < VIEW_COUNT; ++v)
+  {
+    cdlod_view_init(&views[v], &frame, cameras[v][0], cameras[v][1], cameras[v][2], 0.0f, -1.0f);
+    views[v].vertices = view_vertices[v];
+    views[v].vertices_capacity = VERTICES_CAPACITY * 8;
+    views[v].indices = view_indices[v];
+    views[v].indices_capacity = INDICES_CAPACITY * 8;
+    views[v].nodes = view_nodes[v];
+    views[v].nodes_capacity = NODES_CAPACITY;
+  }
+
+  height_calls = 0;
+  views_result = cdlod_frame_traverse_views(&frame, views, VIEW_COUNT);
+  shared_height_calls = height_calls;
+  assert(views_result.status == CDLOD_STATUS_OK);
+
+  /* every view matches a separate traversal with its own camera */
+  for (v = 0; v < VIEW_COUNT; ++v)
+  {
+    cdlod_frame view_frame = frame;
+
+    cdlod_frame_init(&view_frame,
+                     cameras[v][0], cameras[v][1], cameras[v][2], 0.0f, -1.0f,
+                     counting_height_function, 64.0f,
+                     4, lod_ranges, 2);
+    view_frame.skirt_depth = 10.0f;
+    view_frame.patch_resolution = 5;
+    view_frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+    height_calls = 0;
+    cdlod_frame_traverse(&view_frame,
+                         vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                         indices, INDICES_CAPACITY * 8, &indices_count,
+                         nodes, NODES_CAPACITY, &nodes_count);
+    separate_height_calls += height_calls;
+
+    assert(views[v].vertices_count == vertices_count);
+    assert(views[v].indices_count == indices_count);
+    assert(views[v].nodes_count == nodes_count);
+
+    for (i = 0; i < vertices_count; ++i)
+    {
+      if (vertices[i] != view_vertices[v][i])
+      {
+        break;
+      }
+    }
+    assert(i == vertices_count);
+
+    for (i = 0; i < indices_count; ++i)
+    {
+      if (indices[i] != view_indices[v][i])
+      {
+        break;
+      }
+    }
+    assert(i == indices_count);
+
+    for (i = 0; i < nodes_count; ++i)
+    {
+      if (nodes[i].x != view_nodes[v][i].x || nodes[i].z != view_nodes[v][i].z || nodes[i].size != view_nodes[v][i].size)
+      {
+        break;
+      }
+    }
+    assert(i == nodes_count);
+  }
+
+  test_print_string("  views height calls: ");
+  test_print_int(shared_height_calls);
+  test_print_string(" shared vs. ");
+  test_print_int(separate_height_calls);
+  test_print_string(" separate\n");
+
+  assert(shared_height_calls < separate_height_calls);
+
+  /* too many views are rejected instead of dropped, no view is touched */
+  v = views[0].vertices_count;
+  views_result = cdlod_frame_traverse_views(&frame, views, CDLOD_MAX_VIEWS + 1);
+  assert(views_result.status == CDLOD_STATUS_INVALID);
+  assert(views[0].vertices_count == v);
+}
+
+/* stitched seams of every view are classified against the root grid of that view */
+static void cdlod_test_views_seams(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float view_vertices[2][VERTICES_CAPACITY * 8];
+  static int view_indices[2][INDICES_CAPACITY * 8];
+  static cdlod_node view_nodes[2][NODES_CAPACITY];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int mismatches = 0;
+  int v, i;
+
+  /* overlapping grids, the second one shifted by a patch in x and z */
+  float cameras[2][3] = {{0.0f, 10.0f, 0.0f}, {70.0f, 10.0f, 70.0f}};
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_frame frame;
+  cdlod_view views[2];
+
+  cdlod_frame_init(&frame,
+                   0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+  frame.seam_mode = CDLOD_SEAM_STITCH;
+
+  for (v = 0; v < 2; ++v)
+  {
+    cdlod_view_init(&views[v], &frame, cameras[v][0], cameras[v][1], cameras[v][2], 0.0f, -1.0f);
+    views[v].vertices = view_vertices[v];
+    views[v].vertices_capacity = VERTICES_CAPACITY * 8;
+    views[v].indices = view_indices[v];
+    views[v].indices_capacity = INDICES_CAPACITY * 8;
+    views[v].nodes = view_nodes[v];
+    views[v].nodes_capacity = NODES_CAPACITY;
+  }
+  assert(views[0].grid_center_x != views[1].grid_center_x);
+  assert(views[0].grid_center_z != views[1].grid_center_z);
+
+  assert(cdlod_frame_traverse_views(&frame, views, 2).status == CDLOD_STATUS_OK);
+
+  for (v = 0; v < 2; ++v)
+  {
+    cdlod_frame view_frame;
+
+    cdlod_frame_init(&view_frame,
+                     cameras[v][0], cameras[v][1], cameras[v][2], 0.0f, -1.0f,
+                     custom_height_function, 64.0f,
+                     4, lod_ranges, 2);
+    view_frame.patch_resolution = 5;
+    view_frame.morph_mode = CDLOD_MORPH_FACTOR;
+    view_frame.seam_mode = CDLOD_SEAM_STITCH;
+
+    cdlod_frame_traverse(&view_frame,
+                         vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                         indices, INDICES_CAPACITY * 8, &indices_count,
+                         nodes, NODES_CAPACITY, &nodes_count);
+
+    assert(views[v].vertices_count == vertices_count);
+    assert(views[v].indices_count == indices_count);
+    assert(views[v].nodes_count == nodes_count);
+
+    for (i = 0; i < nodes_count; ++i)
+    {
+      mismatches += nodes[i].x != view_nodes[v][i].x || nodes[i].z != view_nodes[v][i].z ||
+                    nodes[i].seams != view_nodes[v][i].seams;
+    }
+
+    for (i = 0; i < vertices_count; ++i)
+    {
+      mismatches += vertices[i] != view_vertices[v][i];
+    }
+
+    for (i = 0; i < indices_count; ++i)
+    {
+      mismatches += indices[i] != view_indices[v][i];
+    }
+  }
+
+  assert(mismatches == 0);
+}
+
+#define SELECTION_CAPACITY 512
+
+static void cdlod_test_selection(void)
+{
+  static cdlod_node selection_nodes[SELECTION_CAPACITY * 2];
+  static cdlod_node previous_nodes[SELECTION_CAPACITY];
+  static int selection_data[SELECTION_CAPACITY * 16];
+  static float pool_vertices[SELECTION_CAPACITY * 12 * 3];
+  static int pool_indices[SELECTION_CAPACITY * (6 + 4 * 6)];
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int first_count;
+  int kept = 0;
+  int removed = 0;
+  int broken = 0;
+  int stale = 0;
+  int step, i, j;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  float wider_ranges[] = {0.0f, 55.0f, 110.0f, 220.0f};
+  cdlod_selection selection;
+  cdlod_frame frame;
+  cdlod_result update_result;
+
+  assert(cdlod_selection_memory_size(SELECTION_CAPACITY) <= SELECTION_CAPACITY * 16);
+  assert(cdlod_selection_init(&selection, selection_nodes, selection_data, SELECTION_CAPACITY * 16, SELECTION_CAPACITY));
+  assert(!cdlod_selection_init(&selection, selection_nodes, selection_data, 16, SELECTION_CAPACITY));
+  assert(cdlod_selection_init(&selection, selection_nodes, selection_data, SELECTION_CAPACITY * 16, SELECTION_CAPACITY));
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+
+  /* first update adds everything */
+  update_result = cdlod_selection_update(&selection, &frame, pool_vertices, pool_indices);
+  assert(update_result.status == CDLOD_STATUS_OK);
+  assert(selection.added_count == selection.count && selection.removed_count == 0);
+  first_count = selection.count;
+
+  for (i = 0; i < SELECTION_CAPACITY; ++i)
+  {
+    previous_nodes[i] = selection.nodes[i];
+  }
+
+  /* moving a bit only changes a few nodes */
+  cdlod_frame_init(&frame,
+                   6.0f, 10.0f, 3.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+
+  update_result = cdlod_selection_update(&selection, &frame, pool_vertices, pool_indices);
+  assert(update_result.status == CDLOD_STATUS_OK);
+  assert(selection.added_count > 0 && selection.removed_count > 0);
+  assert(selection.added_count * 4 < selection.count);
+  assert(selection.count == first_count - selection.removed_count + selection.added_count);
+
+  /* kept nodes stay in their slots */
+  for (i = 0; i < SELECTION_CAPACITY; ++i)
+  {
+    int added = 0;
+
+    for (j = 0; j < selection.added_count; ++j)
+    {
+      added |= selection.added[j] == i;
+    }
+
+    if (selection.slot_update[i] == selection.update && !added)
+    {
+      kept++;
+
+      if (selection.nodes[i].x != previous_nodes[i].x || selection.nodes[i].z != previous_nodes[i].z ||
+          selection.nodes[i].size != previous_nodes[i].size)
+      {
+        break;
+      }
+    }
+  }
+  assert(i == SELECTION_CAPACITY);
+  assert(kept == selection.count - selection.added_count);
+
+  test_print_string("  selection: ");
+  test_print_int(selection.count);
+  test_print_string(" nodes, added: ");
+  test_print_int(selection.added_count);
+  test_print_string(", removed: ");
+  test_print_int(selection.removed_count);
+  test_print_string("\n");
+
+  /* the slots hold exactly the current selection with its geometry */
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+  assert(nodes_count == selection.count);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int *entry = cdlod_selection_find(&selection, cdlod_node_key_of(&nodes[i]));
+    int slot = *entry - 1;
+    int same = slot >= 0 && selection.nodes[slot].size == nodes[i].size;
+
+    for (j = 0; same && j < 12 * 3; ++j)
+    {
+      same = pool_vertices[slot * 12 * 3 + j] == vertices[i * 12 * 3 + j];
+    }
+
+    /* indices are relative to the slot */
+    for (j = 0; same && j < 6 + 4 * 6; ++j)
+    {
+      same = pool_indices[slot * 30 + j] - slot * 12 == indices[i * 30 + j] - i * 12;
+    }
+
+    if (!same)
+    {
+      break;
+    }
+  }
+  assert(i == nodes_count);
+
+  /* removals keep the table exact: one entry per used slot, found at its slot */
+  for (step = 0; step < 32; ++step)
+  {
+    int entries = 0;
+
+    cdlod_frame_init(&frame,
+                     (float)(step * 7 % 90), 10.0f, (float)(step * 13 % 70) - 35.0f, 0.0f, -1.0f,
+                     custom_height_function, 64.0f,
+                     4, lod_ranges, 2);
+    cdlod_selection_update(&selection, &frame, 0, 0);
+    removed += selection.removed_count;
+
+    for (i = 0; i < selection.table_size; ++i)
+    {
+      entries += selection.table[i] != 0;
+    }
+
+    for (i = 0; i < SELECTION_CAPACITY; ++i)
+    {
+      if (selection.slot_update[i] >= 0)
+      {
+        cdlod_node_key key;
+
+        key.x = selection.keys[i * 3 + 0];
+        key.z = selection.keys[i * 3 + 1];
+        key.lod = selection.keys[i * 3 + 2];
+        broken += *cdlod_selection_find(&selection, key) != i + 1;
+      }
+    }
+
+    broken += entries != selection.count;
+  }
+  assert(removed > 0);
+  assert(broken == 0);
+
+  /* nodes that stay selected with a different morph range are emitted again */
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, wider_ranges, 2);
+  cdlod_selection_update(&selection, &frame, 0, 0);
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &nodes_count);
+  assert(nodes_count == selection.count);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    cdlod_node *slot_node = &selection.nodes[*cdlod_selection_find(&selection, cdlod_node_key_of(&nodes[i])) - 1];
+
+    stale += slot_node->morph_start != nodes[i].morph_start || slot_node->morph_end != nodes[i].morph_end;
+  }
+  assert(stale == 0);
+}
+
+#define PATCH_CACHE_CAPACITY 512
+
+static int cdlod_test_same_output(
+    cdlod_frame *frame,
+    float *vertices, int vertices_count, int *indices, int indices_count)
+{
+  static float expected_vertices[VERTICES_CAPACITY * 8];
+  static int expected_indices[INDICES_CAPACITY * 8];
+  int expected_vertices_count = 0;
+  int expected_indices_count = 0;
+  cdlod_frame uncached = *frame;
+  int i;
+
+  uncached.patch_cache = 0;
+  cdlod_frame_traverse(&uncached,
+                       expected_vertices, VERTICES_CAPACITY * 8, &expected_vertices_count,
+                       expected_indices, INDICES_CAPACITY * 8, &expected_indices_count,
+                       0, 0, 0);
+
+  if (vertices_count != expected_vertices_count || indices_count != expected_indices_count)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < vertices_count; ++i)
+  {
+    if (vertices[i] != expected_vertices[i])
+    {
+      return 0;
+    }
+  }
+
+  for (i = 0; i < indices_count; ++i)
+  {
+    if (indices[i] != expected_indices[i])
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void cdlod_test_patch_cache(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float cache_vertices[PATCH_CACHE_CAPACITY * 41 * 4];
+  static int cache_data[PATCH_CACHE_CAPACITY * 8];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int miss_height_calls;
+  int hit_height_calls;
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_patch_cache cache;
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   counting_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  assert(cdlod_patch_cache_vertices_size(&frame, PATCH_CACHE_CAPACITY) <= PATCH_CACHE_CAPACITY * 41 * 4);
+  assert(cdlod_patch_cache_memory_size(&frame, PATCH_CACHE_CAPACITY) <= PATCH_CACHE_CAPACITY * 8);
+  assert(!cdlod_patch_cache_init(&cache, &frame, PATCH_CACHE_CAPACITY, cache_vertices, 64, cache_data, PATCH_CACHE_CAPACITY * 8));
+  assert(cdlod_patch_cache_init(&cache, &frame, PATCH_CACHE_CAPACITY,
+                                cache_vertices, PATCH_CACHE_CAPACITY * 41 * 4,
+                                cache_data, PATCH_CACHE_CAPACITY * 8));
+  frame.patch_cache = &cache;
+
+  /* cold: every patch is a miss */
+  height_calls = 0;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+  miss_height_calls = height_calls;
+  assert(cache.hits == 0 && cache.misses > 0 && cache.count == cache.misses);
+  assert(cdlod_test_same_output(&frame, vertices, vertices_count, indices, indices_count));
+
+  /* warm: every patch is a hit, only node centers are sampled */
+  height_calls = 0;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+  hit_height_calls = height_calls;
+  assert(cache.hits == cache.misses);
+  assert(hit_height_calls * 4 < miss_height_calls);
+  assert(cdlod_test_same_output(&frame, vertices, vertices_count, indices, indices_count));
+
+  test_print_string("  patch cache height calls: ");
+  test_print_int(miss_height_calls);
+  test_print_string(" cold, ");
+  test_print_int(hit_height_calls);
+  test_print_string(" warm\n");
+
+  /* moved camera: morph factors are recomputed for cached patches */
+  frame.camera_x = 20.0f;
+  frame.camera_z = -30.0f;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       0, 0, 0);
+  assert(cache.hits > cache.misses);
+  assert(cdlod_test_same_output(&frame, vertices, vertices_count, indices, indices_count));
+
+  /* a tiny cache keeps evicting but never changes the output */
+  assert(cdlod_patch_cache_init(&cache, &frame, 8,
+                                cache_vertices, PATCH_CACHE_CAPACITY * 41 * 4,
+                                cache_data, PATCH_CACHE_CAPACITY * 8));
+
+  for (i = 0; i < 2; ++i)
+  {
+    cdlod_frame_traverse(&frame,
+                         vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                         indices, INDICES_CAPACITY * 8, &indices_count,
+                         0, 0, 0);
+    assert(cdlod_test_same_output(&frame, vertices, vertices_count, indices, indices_count));
+  }
+  assert(cache.count == 8);
+  assert(cache.misses > 8);
+
+  /* every cached entry is still reachable through the table */
+  for (i = 0; i < cache.count; ++i)
+  {
+    cdlod_node_key key;
+
+    key.x = cache.keys[i * 3 + 0];
+    key.z = cache.keys[i * 3 + 1];
+    key.lod = cache.keys[i * 3 + 2];
+
+    if (cache.table[cdlod_patch_cache_find(&cache, key)] != i + 1)
+    {
+      break;
+    }
+  }
+  assert(i == cache.count);
+
+  /* stitched patches without a coarser neighbour are cached too and have no
+   * skirt ring, buffers sized exactly from a count pass must not overflow.
+   * (the count pass reserves the full index count of a stitched patch)
+   */
+  frame.patch_resolution = 9;
+  frame.seam_mode = CDLOD_SEAM_STITCH;
+  frame.camera_x = 0.0f;
+  frame.camera_y = 60.0f;
+  frame.camera_z = 0.0f;
+  assert(cdlod_patch_cache_init(&cache, &frame, PATCH_CACHE_CAPACITY / 2,
+                                cache_vertices, PATCH_CACHE_CAPACITY * 41 * 4,
+                                cache_data, PATCH_CACHE_CAPACITY * 8));
+
+  {
+    cdlod_result sizes = cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    int capacity_vertices = sizes.vertices_required;
+    int capacity_indices = sizes.indices_required;
+    int clobbered = 0;
+
+    assert(capacity_vertices > 0 && capacity_vertices + 64 <= VERTICES_CAPACITY * 8);
+    assert(capacity_indices > 0 && capacity_indices + 64 <= INDICES_CAPACITY * 8);
+
+    for (i = 0; i < 2; ++i)
+    {
+      int j;
+
+      for (j = 0; j < 64; ++j)
+      {
+        vertices[capacity_vertices + j] = -12345.0f;
+        indices[capacity_indices + j] = -12345;
+      }
+
+      cdlod_frame_traverse(&frame,
+                           vertices, capacity_vertices, &vertices_count,
+                           indices, capacity_indices, &indices_count,
+                           0, 0, 0);
+
+      for (j = 0; j < 64; ++j)
+      {
+        clobbered += vertices[capacity_vertices + j] != -12345.0f;
+        clobbered += indices[capacity_indices + j] != -12345;
+      }
+
+      assert(vertices_count == capacity_vertices && indices_count <= capacity_indices);
+    }
+
+    assert(clobbered == 0);
+    assert(cache.hits > 0);
+    assert(cdlod_test_same_output(&frame, vertices, vertices_count, indices, indices_count));
+  }
+}
+
+#define ROOT_GRID_RADIUS 6
+#define ROOT_GRID_NODES 64
+
+static void cdlod_test_root_grid_frame(cdlod_frame *frame, float camera_x, int culling)
+{
+  static float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  float view_projection[16] = {0};
+  float planes[6 * 4];
+
+  /* looking down -Z, 90 degree fov, near 0.1, far 1000 */
+  view_projection[0] = 1.0f;
+  view_projection[5] = 1.0f;
+  view_projection[10] = -1000.1f / 999.9f;
+  view_projection[11] = -1.0f;
+  view_projection[12] = -camera_x;
+  view_projection[13] = -10.0f;
+  view_projection[14] = -200.0f / 999.9f;
+
+  cdlod_frame_init(frame,
+                   camera_x, 10.0f, 0.0f, 0.0f, -1.0f,
+                   counting_height_function, 64.0f,
+                   4, lod_ranges, ROOT_GRID_RADIUS);
+  frame->skirt_depth = 10.0f;
+  frame->patch_resolution = 5;
+  frame->morph_mode = CDLOD_MORPH_FACTOR;
+
+  if (culling)
+  {
+    cdlod_frustum_from_matrix(planes, view_projection);
+    cdlod_frame_set_frustum(frame, planes, 0.0f, 0.0f);
+  }
+}
+
+static void cdlod_test_root_grid(void)
+{
+  static cdlod_root_slot slots[(2 * ROOT_GRID_RADIUS + 1) * (2 * ROOT_GRID_RADIUS + 1)];
+  static cdlod_node grid_nodes[(2 * ROOT_GRID_RADIUS + 1) * (2 * ROOT_GRID_RADIUS + 1) * ROOT_GRID_NODES];
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float expected_vertices[VERTICES_CAPACITY * 8];
+  static int expected_indices[INDICES_CAPACITY * 8];
+  static cdlod_node nodes[NODES_CAPACITY];
+  static cdlod_node expected_nodes[NODES_CAPACITY];
+  int slot_count = cdlod_root_grid_slot_count(ROOT_GRID_RADIUS);
+  int grid_height_calls = 0;
+  int full_height_calls = 0;
+  int traversed = 0;
+  int mismatches = 0;
+  int culling, step, i;
+
+  cdlod_root_grid grid;
+  cdlod_frame frame;
+
+  assert(!cdlod_root_grid_init(&grid, slots, slot_count - 1, grid_nodes, slot_count * ROOT_GRID_NODES, ROOT_GRID_RADIUS, ROOT_GRID_NODES));
+  assert(!cdlod_root_grid_init(&grid, slots, slot_count, grid_nodes, slot_count * ROOT_GRID_NODES - 1, ROOT_GRID_RADIUS, ROOT_GRID_NODES));
+  assert(cdlod_root_grid_init(&grid, slots, slot_count, grid_nodes, slot_count * ROOT_GRID_NODES, ROOT_GRID_RADIUS, ROOT_GRID_NODES));
+
+  /* a camera moving across several root patches selects the same as a full traversal */
+  for (culling = 0; culling < 2; ++culling)
+  {
+    cdlod_root_grid_clear(&grid);
+
+    for (step = 0; step < 40; ++step)
+    {
+      int vertices_count, indices_count, nodes_count;
+      int expected_vertices_count, expected_indices_count, expected_nodes_count;
+
+      /* selection only (height calls of the traversal), then geometry */
+      cdlod_test_root_grid_frame(&frame, (float)step * 4.0f, culling);
+      height_calls = 0;
+      cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, expected_nodes, NODES_CAPACITY, &expected_nodes_count);
+      full_height_calls += step > 0 ? height_calls : 0;
+      cdlod_frame_traverse(&frame,
+                           expected_vertices, VERTICES_CAPACITY * 8, &expected_vertices_count,
+                           expected_indices, INDICES_CAPACITY * 8, &expected_indices_count,
+                           expected_nodes, NODES_CAPACITY, &expected_nodes_count);
+
+      frame.root_grid = &grid;
+      height_calls = 0;
+      cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &nodes_count);
+      grid_height_calls += step > 0 ? height_calls : 0;
+      traversed += step > 0 ? grid.traversed : 0;
+      cdlod_frame_traverse(&frame,
+                           vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                           indices, INDICES_CAPACITY * 8, &indices_count,
+                           nodes, NODES_CAPACITY, &nodes_count);
+
+      mismatches += grid.traversed != 0;
+      mismatches += vertices_count != expected_vertices_count;
+      mismatches += indices_count != expected_indices_count;
+      mismatches += nodes_count != expected_nodes_count;
+
+      for (i = 0; i < vertices_count && i < expected_vertices_count; ++i)
+      {
+        mismatches += vertices[i] != expected_vertices[i];
+      }
+
+      for (i = 0; i < indices_count && i < expected_indices_count; ++i)
+      {
+        mismatches += indices[i] != expected_indices[i];
+      }
+
+      for (i = 0; i < nodes_count && i < expected_nodes_count; ++i)
+      {
+        mismatches += nodes[i].x != expected_nodes[i].x || nodes[i].z != expected_nodes[i].z ||
+                      nodes[i].lod != expected_nodes[i].lod;
+      }
+    }
+  }
+  assert(mismatches == 0);
+
+  test_print_string("  root grid roots traversed: ");
+  test_print_int(traversed);
+  test_print_string(" of ");
+  test_print_int(2 * 39 * slot_count);
+  test_print_string(", height calls: ");
+  test_print_int(grid_height_calls);
+  test_print_string(" vs. ");
+  test_print_int(full_height_calls);
+  test_print_string("\n");
+
+  assert(traversed * 4 < 2 * 39 * slot_count);
+  assert(grid_height_calls < full_height_calls);
+
+  /* a camera that did not move reuses every root, a cleared grid none */
+  cdlod_test_root_grid_frame(&frame, 156.0f, 0);
+  frame.root_grid = &grid;
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &i);
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &i);
+  assert(grid.traversed == 0 && grid.reused == slot_count);
+
+  cdlod_root_grid_clear(&grid);
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &i);
+  assert(grid.traversed == slot_count && grid.reused == 0);
+
+  /* a changed leaf test drops the kept selections by itself */
+  for (step = 0; step < 3; ++step)
+  {
+    int nodes_count, expected_nodes_count;
+
+    if (step < 2)
+    {
+      cdlod_frame_set_screen_error(&frame, 1.0471976f, 1080.0f, step == 0 ? 16.0f : 32.0f);
+    }
+    else
+    {
+      frame.morph_mode = CDLOD_MORPH_NONE;
+    }
+
+    frame.root_grid = 0;
+    cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, expected_nodes, NODES_CAPACITY, &expected_nodes_count);
+    frame.root_grid = &grid;
+    cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &nodes_count);
+    assert(grid.traversed == slot_count && grid.reused == 0);
+    assert(nodes_count == expected_nodes_count);
+
+    cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &nodes_count);
+    assert(grid.traversed == 0 && grid.reused == slot_count);
+  }
+
+  /* stitched seams of reused roots match a full traversal */
+  cdlod_root_grid_clear(&grid);
+  traversed = 0;
+  mismatches = 0;
+
+  for (step = 0; step < 20; ++step)
+  {
+    int vertices_count, indices_count, nodes_count;
+    int expected_vertices_count, expected_indices_count, expected_nodes_count;
+
+    cdlod_test_root_grid_frame(&frame, (float)step * 4.0f, 0);
+    frame.seam_mode = CDLOD_SEAM_STITCH;
+    cdlod_frame_traverse(&frame,
+                         expected_vertices, VERTICES_CAPACITY * 8, &expected_vertices_count,
+                         expected_indices, INDICES_CAPACITY * 8, &expected_indices_count,
+                         expected_nodes, NODES_CAPACITY, &expected_nodes_count);
+
+    frame.root_grid = &grid;
+    cdlod_frame_traverse(&frame,
+                         vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                         indices, INDICES_CAPACITY * 8, &indices_count,
+                         nodes, NODES_CAPACITY, &nodes_count);
+    traversed += step > 0 ? grid.traversed : 0;
+
+    mismatches += vertices_count != expected_vertices_count;
+    mismatches += indices_count != expected_indices_count;
+    mismatches += nodes_count != expected_nodes_count;
+
+    for (i = 0; i < vertices_count && i < expected_vertices_count; ++i)
+    {
+      mismatches += vertices[i] != expected_vertices[i];
+    }
+
+    for (i = 0; i < indices_count && i < expected_indices_count; ++i)
+    {
+      mismatches += indices[i] != expected_indices[i];
+    }
+
+    for (i = 0; i < nodes_count && i < expected_nodes_count; ++i)
+    {
+      mismatches += nodes[i].x != expected_nodes[i].x || nodes[i].z != expected_nodes[i].z ||
+                    nodes[i].lod != expected_nodes[i].lod || nodes[i].seams != expected_nodes[i].seams;
+    }
+  }
+  assert(mismatches == 0);
+  assert(traversed * 4 < 19 * slot_count);
+}
+
+static void cdlod_test_height_pyramid_scroll(void)
+{
+  static float data[8192];
+  static float expected_data[8192];
+  int build_calls;
+  int scroll_calls;
+  int refitted;
+  int mismatches = 0;
+  int lod, x, z;
+
+  cdlod_height_source counting_height;
+  cdlod_height_pyramid pyramid;
+  cdlod_height_pyramid expected;
+
+  counting_height.function = counting_height_function;
+  counting_height.batch = 0;
+  counting_height.heightmap = 0;
+  counting_height.world = 0;
+
+  assert(cdlod_height_pyramid_init(&pyramid, data, 8192, -2, -2, 5, 5, 64.0f, 4, 5));
+
+  height_calls = 0;
+  cdlod_height_pyramid_build(&pyramid, &counting_height);
+  build_calls = height_calls;
+
+  /* camera crossed one patch boundary in x and two in -z */
+  height_calls = 0;
+  refitted = cdlod_height_pyramid_scroll(&pyramid, &counting_height, -1, -4);
+  scroll_calls = height_calls;
+
+  assert(refitted == 1 * 5 + 2 * 4);
+  assert(scroll_calls * 25 == build_calls * refitted);
+  assert(pyramid.wrap_x == 1 && pyramid.wrap_z == 3);
+
+  /* same bounds as a pyramid built from scratch at the new origin */
+  assert(cdlod_height_pyramid_init(&expected, expected_data, 8192, -1, -4, 5, 5, 64.0f, 4, 5));
+  cdlod_height_pyramid_build(&expected, &counting_height);
+
+  for (lod = 0; lod < 4; ++lod)
+  {
+    float size = 64.0f / (float)(1 << (3 - lod));
+    int nodes = 5 << (3 - lod);
+
+    for (z = 0; z < nodes; ++z)
+    {
+      for (x = 0; x < nodes; ++x)
+      {
+        float px = -64.0f + ((float)x + 0.5f) * size;
+        float pz = -256.0f + ((float)z + 0.5f) * size;
+        float min0, max0, min1, max1;
+
+        if (!cdlod_height_pyramid_query(&pyramid, lod, px, pz, &min0, &max0) ||
+            !cdlod_height_pyramid_query(&expected, lod, px, pz, &min1, &max1) ||
+            min0 != min1 || max0 != max1)
+        {
+          mismatches++;
+        }
+      }
+    }
+  }
+  assert(mismatches == 0);
+
+  /* staying within the same roots is free, jumping far rebuilds */
+  assert(cdlod_height_pyramid_follow(&pyramid, &counting_height, 1, -2) == 0);
+  assert(cdlod_height_pyramid_scroll(&pyramid, &counting_height, 100, 100) == 25);
+  assert(pyramid.wrap_x == 0 && pyramid.wrap_z == 0);
+}
+
+static void cdlod_test_layout(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float xs[VERTICES_CAPACITY * 2];
+  static float ys[VERTICES_CAPACITY * 2];
+  static float zs[VERTICES_CAPACITY * 2];
+  static float ks[VERTICES_CAPACITY * 2];
+  static int soa_indices[INDICES_CAPACITY * 8];
+  static float interleaved[VERTICES_CAPACITY * 2 * 12];
+  static int interleaved_indices[INDICES_CAPACITY * 8];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int soa_indices_count = 0;
+  int interleaved_indices_count = 0;
+  int nodes_count = 0;
+  int mismatches = 0;
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_frame frame;
+  cdlod_layout soa;
+  cdlod_layout layout;
+  cdlod_result layout_result;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   slope_height_function, 64.0f,
+                   4, lod_ranges, 1);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+
+  /* structure of arrays: same positions and morph factors as the interleaved xyzk output */
+  cdlod_layout_soa(&soa, xs, ys, zs, VERTICES_CAPACITY * 2);
+  soa.morph.data = ks;
+
+  layout_result = cdlod_frame_emit_layout(&frame, nodes, nodes_count, &soa,
+                                          soa_indices, INDICES_CAPACITY * 8, &soa_indices_count);
+  assert(layout_result.status == CDLOD_STATUS_OK);
+  assert(soa.count * 4 == vertices_count && layout_result.vertices_required == soa.count);
+  assert(soa_indices_count == indices_count);
+
+  for (i = 0; i < soa.count; ++i)
+  {
+    mismatches += xs[i] != vertices[i * 4 + 0] || ys[i] != vertices[i * 4 + 1] ||
+                  zs[i] != vertices[i * 4 + 2] || ks[i] != vertices[i * 4 + 3];
+  }
+
+  for (i = 0; i < indices_count; ++i)
+  {
+    mismatches += soa_indices[i] != indices[i];
+  }
+  assert(mismatches == 0);
+
+  /* interleaved with a custom stride: xyz, normal, uv, k, padding */
+  cdlod_layout_interleaved(&layout, interleaved, VERTICES_CAPACITY * 2 * 12, 12, 3, 6, 8);
+
+  cdlod_frame_emit_layout(&frame, nodes, nodes_count, &layout,
+                          interleaved_indices, INDICES_CAPACITY * 8, &interleaved_indices_count);
+  assert(layout.count == soa.count);
+
+  for (i = 0; i < layout.count; ++i)
+  {
+    float *v = interleaved + i * 12;
+
+    /* the slope (0.25, 0.5) has the normal (-0.25, 1, -0.5) / |...| everywhere */
+    mismatches += test_absf(v[3] * 0.5f - v[5] * 0.25f) > 0.0001f;
+    mismatches += test_absf(v[3] * v[3] + v[4] * v[4] + v[5] * v[5] - 1.0f) > 0.01f;
+    mismatches += v[6] < 0.0f || v[6] > 1.0f || v[7] < 0.0f || v[7] > 1.0f;
+    mismatches += v[0] != xs[i] || v[8] != ks[i];
+  }
+  assert(mismatches == 0);
+  assert(interleaved[6] == 0.0f && interleaved[7] == 0.0f);
+  assert(interleaved[24 * 12 + 6] == 1.0f && interleaved[24 * 12 + 7] == 1.0f);
+  assert_equalsf(interleaved[4], 1.0f / 1.1456439f, 0.001f);
+
+  /* too small layouts are reported */
+  cdlod_layout_soa(&soa, xs, ys, zs, 64);
+  layout_result = cdlod_frame_emit_layout(&frame, nodes, nodes_count, &soa,
+                                          soa_indices, INDICES_CAPACITY * 8, &soa_indices_count);
+  assert(layout_result.status == CDLOD_STATUS_VERTICES_FULL);
+  assert(soa.count <= 64);
+}
+
+static float bowl_height_function(float x, float z)
+{
+  return 0.01f * (x * x + z * z);
+}
+
+static void cdlod_test_normals(void)
+{
+  static float xs[128];
+  static float ys[128];
+  static float zs[128];
+  static float normals[128 * 3];
+  static float tangents[128 * 3];
+  static int indices[1024];
+  int indices_count = 0;
+  int mismatches = 0;
+  int i, z;
+
+  cdlod_height_source height = {0};
+  cdlod_layout layout;
+  cdlod_node left = {0};
+  cdlod_node right = {0};
+
+  height.function = bowl_height_function;
+
+  /* two neighbouring nodes sharing the border x = 0 */
+  left.x = -8.0f;
+  left.z = 8.0f;
+  left.size = 16.0f;
+  right = left;
+  right.x = 8.0f;
+
+  cdlod_layout_soa(&layout, xs, ys, zs, 128);
+  layout.normal.data = normals;
+  layout.tangent.data = tangents;
+
+  assert(cdlod_generate_grid_patch_layout(&layout, indices, 1024, &indices_count, &left, &height,
+                                          1.0f, 5, CDLOD_MORPH_NONE, 0.0f, 0.0f, 0.0f));
+  assert(cdlod_generate_grid_patch_layout(&layout, indices, 1024, &indices_count, &right, &height,
+                                          1.0f, 5, CDLOD_MORPH_NONE, 0.0f, 0.0f, 0.0f));
+  assert(layout.count == 82);
+
+  /* central differences are exact on a quadratic, including the patch borders */
+  for (i = 0; i < 25; ++i)
+  {
+    float dx = 0.02f * xs[i];
+    float dz = 0.02f * zs[i];
+    float len = 1.0f / cdlod_invsqrt(dx * dx + 1.0f + dz * dz);
+
+    mismatches += test_absf(normals[i * 3 + 0] * len + dx) > 0.001f;
+    mismatches += test_absf(normals[i * 3 + 1] * len - 1.0f) > 0.001f;
+    mismatches += test_absf(normals[i * 3 + 2] * len + dz) > 0.001f;
+    mismatches += test_absf(tangents[i * 3 + 1] - dx * tangents[i * 3 + 0]) > 0.001f;
+  }
+  assert(mismatches == 0);
+
+  /* the shared border vertices get identical normals from both patches */
+  for (z = 0; z < 5; ++z)
+  {
+    int a = z * 5 + 4;
+    int b = 41 + z * 5;
+
+    mismatches += xs[a] != xs[b] || zs[a] != zs[b];
+    mismatches += normals[a * 3 + 0] != normals[b * 3 + 0] ||
+                  normals[a * 3 + 1] != normals[b * 3 + 1] ||
+                  normals[a * 3 + 2] != normals[b * 3 + 2];
+  }
+  assert(mismatches == 0);
+
+  /* skirt vertices carry the normal of their border vertex */
+  assert(normals[25 * 3 + 1] > 0.0f && tangents[25 * 3 + 0] > 0.0f);
+}
+
+/* number of used patch border vertices that are not a used vertex of another
+ * patch (T-junctions), ignoring the outer border of the root grid
+ */
+static int cdlod_test_t_junctions(cdlod_frame *frame, cdlod_node *nodes, int nodes_count)
+{
+  static float border_xs[16384];
+  static float border_zs[16384];
+  static int border_patches[16384];
+  static float patch_vertices[25 * 3 + 16 * 3];
+  static int patch_indices[INDICES_CAPACITY];
+  int border_count = 0;
+  int t_junctions = 0;
+  float grid_min_x = (float)(frame->grid_center_x - frame->grid_radius) * frame->patch_size;
+  float grid_max_x = (float)(frame->grid_center_x + frame->grid_radius + 1) * frame->patch_size;
+  float grid_min_z = (float)(frame->grid_center_z - frame->grid_radius) * frame->patch_size;
+  float grid_max_z = (float)(frame->grid_center_z + frame->grid_radius + 1) * frame->patch_size;
+  int i, j;
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    float half = nodes[i].size * 0.5f;
+    int vertices_count = 0;
+    int indices_count = 0;
+
+    cdlod_generate_grid_patch(patch_vertices, 25 * 3 + 16 * 3, &vertices_count,
+                              patch_indices, INDICES_CAPACITY, &indices_count,
+                              &nodes[i], &frame->height, 10.0f,
+                              frame->patch_resolution, CDLOD_MORPH_NONE, 0.0f, 0.0f, 0.0f);
+
+    /* used grid vertices on the patch border (skirt vertices are below the grid) */
+    for (j = 0; j < frame->patch_resolution * frame->patch_resolution; ++j)
+    {
+      float x = patch_vertices[j * 3 + 0];
+      float z = patch_vertices[j * 3 + 2];
+      int used = 0;
+      int k;
+
+      if (x != nodes[i].x - half && x != nodes[i].x + half && z != nodes[i].z - half && z != nodes[i].z + half)
+      {
+        continue;
+      }
+
+      if (x == grid_min_x || x == grid_max_x || z == grid_min_z || z == grid_max_z)
+      {
+        continue;
+      }
+
+      for (k = 0; k < indices_count && !used; ++k)
+      {
+        used = patch_indices[k] == j;
+      }
+
+      if (used && border_count == 16384)
+      {
+        return -1;
+      }
+
+      if (used)
+      {
+        border_xs[border_count] = x;
+        border_zs[border_count] = z;
+        border_patches[border_count] = i;
+        border_count++;
+      }
+    }
+  }
+
+  for (i = 0; i < border_count; ++i)
+  {
+    for (j = 0; j < border_count; ++j)
+    {
+      if (border_patches[j] != border_patches[i] && border_xs[j] == border_xs[i] && border_zs[j] == border_zs[i])
+      {
+        break;
+      }
+    }
+
+    t_junctions += j == border_count;
+  }
+
+  return t_junctions;
+}
+
+static void cdlod_test_seams(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static float cache_vertices[PATCH_CACHE_CAPACITY * 25 * 3];
+  static int cache_data[PATCH_CACHE_CAPACITY * 8];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int skirt_vertices_count;
+  int skirt_indices_count;
+  int nodes_count = 0;
+  int stitched_edges = 0;
+  int unstitched = 0;
+  int i, j;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  cdlod_patch_cache cache;
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, lod_ranges, 2);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+
+  /* skirts: lod borders have T-junctions */
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+  skirt_vertices_count = vertices_count;
+  skirt_indices_count = indices_count;
+  assert(nodes[0].seams == 0);
+  assert(cdlod_test_t_junctions(&frame, nodes, nodes_count) > 0);
+
+  /* stitched: same nodes, no skirts and no T-junctions */
+  frame.seam_mode = CDLOD_SEAM_STITCH;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    unstitched += !(nodes[i].seams & CDLOD_SEAMS_STITCHED);
+
+    for (j = 0; j < 4; ++j)
+    {
+      stitched_edges += cdlod_node_seam(&nodes[i], j) > 0;
+    }
+  }
+
+  assert(unstitched == 0 && stitched_edges > 0);
+  assert(cdlod_test_t_junctions(&frame, nodes, nodes_count) == 0);
+  assert(vertices_count == nodes_count * 25 * 3);
+  assert(indices_count < nodes_count * 4 * 4 * 6);
+
+  test_print_string("  seams vertices: ");
+  test_print_int(vertices_count);
+  test_print_string(" vs. ");
+  test_print_int(skirt_vertices_count);
+  test_print_string(", indices: ");
+  test_print_int(indices_count);
+  test_print_string(" vs. ");
+  test_print_int(skirt_indices_count);
+  test_print_string(" with skirts\n");
+
+  /* stitched patches bypass the patch cache, unstitched ones are cached */
+  assert(cdlod_patch_cache_init(&cache, &frame, PATCH_CACHE_CAPACITY,
+                                cache_vertices, PATCH_CACHE_CAPACITY * 25 * 3,
+                                cache_data, PATCH_CACHE_CAPACITY * 8));
+  frame.patch_cache = &cache;
+
+  for (i = 0; i < 2; ++i)
+  {
+    cdlod_frame_traverse(&frame,
+                         vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                         indices, INDICES_CAPACITY * 8, &indices_count,
+                         0, 0, 0);
+    assert(cdlod_test_same_output(&frame, vertices, vertices_count, indices, indices_count));
+  }
+  assert(cache.hits > 0 && cache.count < nodes_count);
+}
+
+static void cdlod_test_quantized(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  static short quantized_vertices[VERTICES_CAPACITY * 8];
+  static unsigned short quantized_indices[INDICES_CAPACITY * 8];
+  float scratch_vertices[41 * 4];
+  int scratch_indices[192];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int quantized_vertices_count = 0;
+  int quantized_indices_count = 0;
+  int nodes_count = 0;
+  int mismatches = 0;
+  int negative_offsets = 0;
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f};
+  float height_min = -20.0f;
+  float height_max = 20.0f;
+  cdlod_frame frame;
+  cdlod_result quantized_result;
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   4, lod_ranges, 1);
+  frame.skirt_depth = 10.0f;
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                       indices, INDICES_CAPACITY * 8, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+
+  quantized_result = cdlod_frame_emit_quantized(&frame, nodes, nodes_count,
+                                                scratch_vertices, scratch_indices,
+                                                quantized_vertices, VERTICES_CAPACITY * 8, &quantized_vertices_count,
+                                                quantized_indices, INDICES_CAPACITY * 8, &quantized_indices_count,
+                                                height_min, height_max);
+  assert(quantized_result.status == CDLOD_STATUS_OK);
+  assert(quantized_vertices_count == vertices_count);
+  assert(quantized_indices_count == indices_count);
+
+  /* dequantized positions match within one quantization step */
+  for (i = 0; i < vertices_count / 4; ++i)
+  {
+    cdlod_node *node = &nodes[i / 41];
+    short *q = quantized_vertices + i * 4;
+    float *v = vertices + i * 4;
+    float x = node->x + (float)q[0] / 32767.0f * node->size * 0.5f;
+    float y = (height_min + height_max) * 0.5f + (float)q[1] / 32767.0f * (height_max - height_min) * 0.5f;
+    float z = node->z + (float)q[2] / 32767.0f * node->size * 0.5f;
+    float k = (float)q[3] / 32767.0f;
+    float expected_y = v[1] < height_min ? height_min : (v[1] > height_max ? height_max : v[1]);
+
+    /* offsets from the node center are signed */
+    negative_offsets += q[0] < 0 && q[2] < 0;
+
+    mismatches += test_absf(x - v[0]) > node->size / 65534.0f;
+    mismatches += test_absf(z - v[2]) > node->size / 65534.0f;
+    mismatches += test_absf(y - expected_y) > (height_max - height_min) / 65534.0f;
+    mismatches += test_absf(k - v[3]) > 1.0f / 32767.0f;
+  }
+
+  /* patch local indices */
+  for (i = 0; i < indices_count; ++i)
+  {
+    mismatches += (int)quantized_indices[i] != indices[i] - (i / 192) * 41;
+  }
+  assert(mismatches == 0);
+  assert(negative_offsets > 0);
+
+  test_print_string("  quantized bytes: ");
+  test_print_int(quantized_vertices_count * (int)sizeof(short) + quantized_indices_count * (int)sizeof(unsigned short));
+  test_print_string(" vs. ");
+  test_print_int(vertices_count * (int)sizeof(float) + indices_count * (int)sizeof(int));
+  test_print_string("\n");
+
+  /* patches too large for 16 bit indices are rejected without writing anything */
+  frame.patch_resolution = 257;
+  quantized_result = cdlod_frame_emit_quantized(&frame, nodes, nodes_count,
+                                                scratch_vertices, scratch_indices,
+                                                quantized_vertices, VERTICES_CAPACITY * 8, &quantized_vertices_count,
+                                                quantized_indices, INDICES_CAPACITY * 8, &quantized_indices_count,
+                                                height_min, height_max);
+  assert(quantized_result.status == CDLOD_STATUS_INVALID);
+  assert(quantized_vertices_count == 0 && quantized_indices_count == 0);
+
+  /* skirts push a 255 x 255 patch over the limit */
+  frame.patch_resolution = 255;
+  quantized_result = cdlod_frame_emit_quantized(&frame, nodes, nodes_count,
+                                                scratch_vertices, scratch_indices,
+                                                quantized_vertices, VERTICES_CAPACITY * 8, &quantized_vertices_count,
+                                                quantized_indices, INDICES_CAPACITY * 8, &quantized_indices_count,
+                                                height_min, height_max);
+  assert(quantized_result.status == CDLOD_STATUS_INVALID);
+  assert(cdlod_grid_patch_vertex_count(254) <= 65536);
+}
+
+static void cdlod_test_patch_kernel(void)
+{
+  static cdlod_quadtree_node nodes[64];
+  static float heights[64 * 4];
+  static float scalar_vertices[64 * 36];
+  static float simd_vertices[64 * 36];
+  static int scalar_indices[64 * 30];
+  static int simd_indices[64 * 30];
+  int scalar_vertices_count = 0;
+  int scalar_indices_count = 0;
+  int simd_vertices_count = 0;
+  int simd_indices_count = 0;
+  int mismatches = 0;
+  int i;
+
+  for (i = 0; i < 64; ++i)
+  {
+    nodes[i].x = (float)(i % 8) * 32.0f - 112.0f;
+    nodes[i].z = (float)(i / 8) * 32.0f - 112.0f;
+    nodes[i].size = 32.0f;
+    nodes[i].lod = 0;
+    heights[i * 4 + 0] = custom_height_function(nodes[i].x - 16.0f, nodes[i].z - 16.0f);
+    heights[i * 4 + 1] = custom_height_function(nodes[i].x + 16.0f, nodes[i].z - 16.0f);
+    heights[i * 4 + 2] = custom_height_function(nodes[i].x + 16.0f, nodes[i].z + 16.0f);
+    heights[i * 4 + 3] = custom_height_function(nodes[i].x - 16.0f, nodes[i].z + 16.0f);
+  }
+
+  /* the SIMD kernel (when compiled in) matches the scalar kernel exactly */
+  assert(cdlod_generate_patches_scalar(scalar_vertices, 64 * 36, &scalar_vertices_count,
+                                       scalar_indices, 64 * 30, &scalar_indices_count,
+                                       nodes, heights, 64, 10.0f) == 64);
+  assert(cdlod_generate_patches_sampled(simd_vertices, 64 * 36, &simd_vertices_count,
+                                        simd_indices, 64 * 30, &simd_indices_count,
+                                        nodes, heights, 64, 10.0f) == 64);
+  assert(simd_vertices_count == scalar_vertices_count && simd_indices_count == scalar_indices_count);
+
+  for (i = 0; i < scalar_vertices_count; ++i)
+  {
+    mismatches += simd_vertices[i] != scalar_vertices[i];
+  }
+
+  for (i = 0; i < scalar_indices_count; ++i)
+  {
+    mismatches += simd_indices[i] != scalar_indices[i];
+  }
+  assert(mismatches == 0);
+
+  /* same output as the single patch generator */
+  simd_vertices_count = 0;
+  simd_indices_count = 0;
+  assert(cdlod_generate_patch_sampled(simd_vertices, 36, &simd_vertices_count,
+                                      simd_indices, 30, &simd_indices_count,
+                                      &nodes[0], heights[0], heights[1], heights[2], heights[3], 10.0f));
+  assert(simd_vertices[35] == scalar_vertices[35] && simd_indices[29] == scalar_indices[29]);
+
+  /* only the patches that fit are written */
+  simd_vertices_count = 36;
+  simd_indices_count = 30;
+  assert(cdlod_generate_patches_sampled(simd_vertices, 36 * 4, &simd_vertices_count,
+                                        simd_indices, 30 * 8, &simd_indices_count,
+                                        nodes, heights, 64, 10.0f) == 3);
+  assert(simd_vertices_count == 36 * 4 && simd_indices_count == 30 * 4);
+  assert(simd_indices[30] == 12);
+
+  /* microbenchmark over 64 nodes (the output stays in the L1 cache): one patch per call vs. the batched scalar and SIMD kernels */
+  for (i = 0; i < 10000; ++i)
+  {
+    int j;
+
+    scalar_vertices_count = 0;
+    scalar_indices_count = 0;
+    PERF_PROFILE_WITH_NAME(
+        {
+          for (j = 0; j < 64; ++j)
+          {
+            cdlod_generate_patch_sampled(scalar_vertices, 64 * 36, &scalar_vertices_count,
+                                         scalar_indices, 64 * 30, &scalar_indices_count,
+                                         &nodes[j], heights[j * 4 + 0], heights[j * 4 + 1],
+                                         heights[j * 4 + 2], heights[j * 4 + 3], 10.0f);
+          }
+        }, "patches_single");
+
+    scalar_vertices_count = 0;
+    scalar_indices_count = 0;
+    PERF_PROFILE_WITH_NAME(
+        { cdlod_generate_patches_scalar(scalar_vertices, 64 * 36, &scalar_vertices_count,
+                                        scalar_indices, 64 * 30, &scalar_indices_count,
+                                        nodes, heights, 64, 10.0f); }, "patches_scalar");
+
+    simd_vertices_count = 0;
+    simd_indices_count = 0;
+    PERF_PROFILE_WITH_NAME(
+        { cdlod_generate_patches_sampled(simd_vertices, 64 * 36, &simd_vertices_count,
+                                         simd_indices, 64 * 30, &simd_indices_count,
+                                         nodes, heights, 64, 10.0f); }, "patches_simd");
+  }
+}
+
+static void cdlod_test_levels(void)
+{
+  static cdlod_node depth_nodes[NODES_CAPACITY];
+  static cdlod_node level_nodes[NODES_CAPACITY];
+  static float levels[4096 * 6];
+  static float depth_vertices[VERTICES_CAPACITY * 8];
+  static float level_vertices[VERTICES_CAPACITY * 8];
+  static int depth_indices[INDICES_CAPACITY * 8];
+  static int level_indices[INDICES_CAPACITY * 8];
+  int depth_count = 0;
+  int level_count = 0;
+  int depth_vertices_count = 0;
+  int level_vertices_count = 0;
+  int depth_indices_count = 0;
+  int level_indices_count = 0;
+  int missing = 0;
+  int i, j;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f, 400.0f};
+  cdlod_frame frame;
+  cdlod_result depth_result;
+  cdlod_result level_result;
+
+  assert(cdlod_frame_levels_memory_size(4096) == 4096 * 6);
+
+  /* 41 x 41 root grid */
+  cdlod_frame_init(&frame,
+                   10.0f, 20.0f, -5.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   5, lod_ranges, 20);
+
+  assert(frame.lod_max_size[0] == 4.0f && frame.lod_max_size[4] == 64.0f);
+  assert(frame.lod_leaf_dist_sq[0] < 0.0f && frame.lod_leaf_dist_sq[2] == 100.0f * 100.0f);
+
+  depth_result = cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, depth_nodes, NODES_CAPACITY, &depth_count);
+  level_result = cdlod_frame_traverse_levels(&frame, levels, 4096 * 6, 0, 0, 0, 0, 0, 0,
+                                             level_nodes, NODES_CAPACITY, &level_count);
+
+  /* same selection, coarse levels first */
+  assert(level_result.status == CDLOD_STATUS_OK && depth_result.status == CDLOD_STATUS_OK);
+  assert(level_count == depth_count && level_count > 41 * 41);
+
+  for (i = 0; i < level_count; ++i)
+  {
+    for (j = 0; j < depth_count; ++j)
+    {
+      if (level_nodes[i].x == depth_nodes[j].x && level_nodes[i].z == depth_nodes[j].z &&
+          level_nodes[i].size == depth_nodes[j].size && level_nodes[i].morph_end == depth_nodes[j].morph_end)
+      {
+        break;
+      }
+    }
+
+    missing += j == depth_count;
+    missing += i > 0 && level_nodes[i].lod > level_nodes[i - 1].lod;
+  }
+  assert(missing == 0);
+
+  /* geometry output with batched heights matches in size */
+  frame.grid_radius = 3;
+  frame.height.batch = counting_height_batch_function;
+  frame.patch_resolution = 5;
+
+  cdlod_frame_traverse(&frame,
+                       depth_vertices, VERTICES_CAPACITY * 8, &depth_vertices_count,
+                       depth_indices, INDICES_CAPACITY * 8, &depth_indices_count,
+                       0, 0, 0);
+  level_result = cdlod_frame_traverse_levels(&frame, levels, 4096 * 6,
+                                             level_vertices, VERTICES_CAPACITY * 8, &level_vertices_count,
+                                             level_indices, INDICES_CAPACITY * 8, &level_indices_count,
+                                             0, 0, 0);
+  assert(level_result.status == CDLOD_STATUS_OK);
+  assert(level_vertices_count == depth_vertices_count && level_indices_count == depth_indices_count);
+
+  /* too small levels drop nodes */
+  level_result = cdlod_frame_traverse_levels(&frame, levels, 6 * 6, 0, 0, 0, 0, 0, 0,
+                                             level_nodes, NODES_CAPACITY, &level_count);
+  assert(level_result.status & CDLOD_STATUS_STACK_FULL);
+
+  frame.height.batch = 0;
+  frame.patch_resolution = 0;
+  frame.grid_radius = 20;
+
+  for (i = 0; i < 1000; ++i)
+  {
+    PERF_PROFILE_WITH_NAME(
+        { cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, depth_nodes, NODES_CAPACITY, &depth_count); },
+        "traverse (depth first)");
+
+    PERF_PROFILE_WITH_NAME(
+        { cdlod_frame_traverse_levels(&frame, levels, 4096 * 6, 0, 0, 0, 0, 0, 0,
+                                      level_nodes, NODES_CAPACITY, &level_count); },
+        "traverse (levels)");
+  }
+}
+
+static void cdlod_test_screen_error(void)
+{
+  static cdlod_node nodes[NODES_CAPACITY];
+  static cdlod_node scaled_nodes[NODES_CAPACITY];
+  static cdlod_node level_nodes[NODES_CAPACITY];
+  static float levels[4096 * 6];
+  static float pyramid_data[4096];
+  int count = 0;
+  int scaled_count = 0;
+  int level_count = 0;
+  int coarse_count = 0;
+  int range_count = 0;
+  int mismatches = 0;
+  int bad_morphs = 0;
+  int i;
+
+  float lod_ranges[] = {0.0f, 20.0f, 40.0f, 80.0f, 160.0f};
+  float flat_ranges[] = {0.0f, 40.0f, 80.0f};
+  cdlod_height_pyramid pyramid;
+  cdlod_frame frame;
+  cdlod_result screen_result;
+
+  assert_equalsf(cdlod_tanf(0.7853982f), 1.0f, 0.001f);
+  assert_equalsf(cdlod_tanf(0.5235988f), 0.5773503f, 0.001f);
+
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, -5.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 9;
+
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &range_count);
+
+  /* 60 degree fov, 1080p at 16 pixels selects the same nodes as 2160p at 32 pixels */
+  cdlod_frame_set_screen_error(&frame, 1.0471976f, 1080.0f, 16.0f);
+  assert_equalsf(frame.screen_scale, 1080.0f / (2.0f * 0.5773503f), 0.5f);
+
+  screen_result = cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &count);
+  assert(screen_result.status == CDLOD_STATUS_OK);
+  assert(count > 0 && count != range_count);
+
+  cdlod_frame_set_screen_error(&frame, 1.0471976f, 2160.0f, 32.0f);
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, scaled_nodes, NODES_CAPACITY, &scaled_count);
+  assert(scaled_count == count);
+
+  for (i = 0; i < count && i < scaled_count; ++i)
+  {
+    mismatches += nodes[i].x != scaled_nodes[i].x || nodes[i].z != scaled_nodes[i].z || nodes[i].lod != scaled_nodes[i].lod;
+
+    /* nodes morph into their parent before the parent is selected */
+    if (nodes[i].lod + 1 < frame.lod_count)
+    {
+      bad_morphs += !(nodes[i].morph_start > 0.0f && nodes[i].morph_start <= nodes[i].morph_end);
+    }
+  }
+  assert(mismatches == 0);
+  assert(bad_morphs == 0);
+
+  /* breadth first traversal selects the same nodes */
+  cdlod_frame_traverse_levels(&frame, levels, 4096 * 6, 0, 0, 0, 0, 0, 0,
+                              level_nodes, NODES_CAPACITY, &level_count);
+  assert(level_count == scaled_count);
+
+  /* a larger pixel error selects fewer nodes */
+  cdlod_frame_set_screen_error(&frame, 1.0471976f, 1080.0f, 64.0f);
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &coarse_count);
+  assert(coarse_count < count);
+
+  /* flat terrain covered by the height pyramid has no error: roots only */
+  assert(cdlod_height_pyramid_init(&pyramid, pyramid_data, 4096, -2, -2, 4, 4, 64.0f, 3, 2));
+  cdlod_height_pyramid_build(&pyramid, &frame.height);
+
+  cdlod_frame_init(&frame,
+                   0.0f, 10.0f, 0.0f, 0.0f, 0.0f,
+                   custom_height_function, 64.0f,
+                   3, flat_ranges, 1);
+  frame.height_pyramid = &pyramid;
+  cdlod_frame_set_screen_error(&frame, 1.0471976f, 1080.0f, 1.0f);
+
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &count);
+  assert(count == 3 * 3);
+}
+
+static float dome_height_function(float x, float z)
+{
+  return (x * x + z * z * 0.5f) * 0.0005f;
+}
+
+/* screen space error: same lod neighbours share their border vertices, lods
+ * of neighbouring nodes differ by at most one
+ */
+static void cdlod_test_screen_error_seams(void)
+{
+  static float pyramid_data[43648];
+  static float vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  static cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int patch_vertices = cdlod_grid_patch_vertex_count(9);
+  int shared_edges = 0;
+  int morphed_edges = 0;
+  int mismatches = 0;
+  int lod_jumps = 0;
+  int i, j, k;
+
+  float lod_ranges[] = {0.0f, 20.0f, 40.0f, 80.0f, 160.0f};
+  cdlod_height_pyramid pyramid;
+  cdlod_frame frame;
+  cdlod_result screen_result;
+
+  assert(cdlod_height_pyramid_memory_size(8, 8, 5) <= 43648);
+  assert(cdlod_height_pyramid_init(&pyramid, pyramid_data, 43648, -4, -4, 8, 8, 64.0f, 5, 9));
+
+  cdlod_frame_init(&frame,
+                   10.0f, 30.0f, -5.0f, 0.0f, -1.0f,
+                   dome_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  cdlod_height_pyramid_build(&pyramid, &frame.height);
+  frame.patch_resolution = 9;
+  frame.morph_mode = CDLOD_MORPH_POSITION;
+  frame.height_pyramid = &pyramid;
+  cdlod_frame_set_screen_error(&frame, 1.0471976f, 1080.0f, 128.0f);
+
+  screen_result = cdlod_frame_traverse(&frame,
+                                       vertices, VERTICES_CAPACITY * 32, &vertices_count,
+                                       indices, INDICES_CAPACITY * 32, &indices_count,
+                                       nodes, NODES_CAPACITY, &nodes_count);
+  assert(screen_result.status == CDLOD_STATUS_OK);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    for (j = 0; j < nodes_count; ++j)
+    {
+      cdlod_node *a = &nodes[i];
+      cdlod_node *b = &nodes[j];
+      float ha = a->size * 0.5f;
+      float hb = b->size * 0.5f;
+      float overlap_z = (a->z + ha < b->z + hb ? a->z + ha : b->z + hb) - (a->z - ha > b->z - hb ? a->z - ha : b->z - hb);
+      float overlap_x = (a->x + ha < b->x + hb ? a->x + ha : b->x + hb) - (a->x - ha > b->x - hb ? a->x - ha : b->x - hb);
+
+      /* b touches the right or top edge of a */
+      if ((a->x + ha == b->x - hb && overlap_z > 0.0f) || (a->z + ha == b->z - hb && overlap_x > 0.0f))
+      {
+        lod_jumps += a->lod - b->lod > 1 || b->lod - a->lod > 1;
+      }
+
+      if (a->lod != b->lod)
+      {
+        continue;
+      }
+
+      /* right edge of a (x = 8) against the left edge of b (x = 0) */
+      if (a->x + a->size == b->x && a->z == b->z)
+      {
+        float *va = vertices + i * patch_vertices * 3;
+        float *vb = vertices + j * patch_vertices * 3;
+        int morphed = 0;
+
+        for (k = 0; k < 9; ++k)
+        {
+          float *pa = va + (k * 9 + 8) * 3;
+          float *pb = vb + (k * 9) * 3;
+
+          mismatches += pa[0] != pb[0] || pa[1] != pb[1] || pa[2] != pb[2];
+          morphed += pa[2] != a->z - a->size * 0.5f + (float)k * a->size / 8.0f;
+        }
+
+        shared_edges++;
+        morphed_edges += morphed > 0;
+      }
+
+      /* top edge of a (z = 8) against the bottom edge of b (z = 0) */
+      if (a->z + a->size == b->z && a->x == b->x)
+      {
+        float *va = vertices + i * patch_vertices * 3;
+        float *vb = vertices + j * patch_vertices * 3;
+        int morphed = 0;
+
+        for (k = 0; k < 9; ++k)
+        {
+          float *pa = va + (8 * 9 + k) * 3;
+          float *pb = vb + k * 3;
+
+          mismatches += pa[0] != pb[0] || pa[1] != pb[1] || pa[2] != pb[2];
+          morphed += pa[0] != a->x - a->size * 0.5f + (float)k * a->size / 8.0f;
+        }
+
+        shared_edges++;
+        morphed_edges += morphed > 0;
+      }
+    }
+  }
+
+  test_print_string("  screen error shared edges: ");
+  test_print_int(shared_edges);
+  test_print_string(" (");
+  test_print_int(morphed_edges);
+  test_print_string(" morphing)\n");
+
+  assert(shared_edges > 0 && morphed_edges > 0);
+  assert(mismatches == 0);
+  assert(lod_jumps == 0);
+}
+
+static void cdlod_test_budget(void)
+{
+  static cdlod_node nodes[NODES_CAPACITY];
+  static cdlod_node budget_nodes[NODES_CAPACITY];
+  static float queue[1024 * 6];
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 16];
+  int count = 0;
+  int budget_count = 0;
+  int vertices_count = 0;
+  int indices_count = 0;
+  int missing = 0;
+  int near_finest = 0;
+  int refinable = 0;
+  int patch_vertices = cdlod_grid_patch_vertex_count(9);
+  int vertex_budget;
+  int i, j, k;
+
+  float lod_ranges[] = {0.0f, 20.0f, 40.0f, 80.0f, 160.0f};
+  cdlod_frame frame;
+  cdlod_result full_result;
+  cdlod_result budget_result;
+  float view_projection[16] = {0};
+  float planes[6 * 4];
+
+  assert(cdlod_frame_budget_memory_size(1024) == 1024 * 6);
+
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, -5.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 9;
+
+  /* no budget: same selection as the depth first traversal */
+  full_result = cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &count);
+  budget_result = cdlod_frame_traverse_budget(&frame, queue, 1024 * 6, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              budget_nodes, NODES_CAPACITY, &budget_count);
+  assert(budget_result.status == CDLOD_STATUS_OK);
+  assert(budget_count == count && budget_result.vertices_required == full_result.vertices_required);
+
+  for (i = 0; i < budget_count; ++i)
+  {
+    for (j = 0; j < count; ++j)
+    {
+      if (budget_nodes[i].x == nodes[j].x && budget_nodes[i].z == nodes[j].z && budget_nodes[i].lod == nodes[j].lod)
+      {
+        break;
+      }
+    }
+
+    missing += j == count;
+  }
+  assert(missing == 0);
+
+  /* half the vertices: a hard upper bound, the camera keeps the finest lod */
+  budget_result = cdlod_frame_traverse_budget(&frame, queue, 1024 * 6, count * patch_vertices / 2, 0,
+                                              vertices, VERTICES_CAPACITY * 8, &vertices_count,
+                                              indices, INDICES_CAPACITY * 16, &indices_count,
+                                              budget_nodes, NODES_CAPACITY, &budget_count);
+  assert(budget_result.status == CDLOD_STATUS_BUDGET);
+  assert(budget_count > 5 * 5 && budget_count * patch_vertices <= count * patch_vertices / 2);
+  assert(vertices_count == budget_count * patch_vertices * cdlod_frame_vertex_stride(&frame));
+
+  for (i = 0; i < budget_count; ++i)
+  {
+    near_finest += budget_nodes[i].lod == 0 &&
+               (budget_nodes[i].x - 10.0f) * (budget_nodes[i].x - 10.0f) +
+                       (budget_nodes[i].z + 5.0f) * (budget_nodes[i].z + 5.0f) <
+                   4.0f * 4.0f;
+  }
+  assert(near_finest > 0);
+
+  /* triangle budget */
+  budget_result = cdlod_frame_traverse_budget(&frame, queue, 1024 * 6, 0, budget_result.indices_required / 3 / 2,
+                                              0, 0, 0, 0, 0, 0, budget_nodes, NODES_CAPACITY, &budget_count);
+  assert(budget_result.status == CDLOD_STATUS_BUDGET);
+  assert(budget_result.indices_required / 3 <= indices_count / 3 / 2);
+
+  /* the visible roots are always selected and reported if they exceed the budget */
+  budget_result = cdlod_frame_traverse_budget(&frame, queue, 1024 * 6, 1, 0, 0, 0, 0, 0, 0, 0,
+                                              budget_nodes, NODES_CAPACITY, &budget_count);
+  assert(budget_result.status == (CDLOD_STATUS_BUDGET | CDLOD_STATUS_OVER_BUDGET));
+  assert(budget_count == 5 * 5);
+
+  /* too small queue selects nodes without refinement */
+  budget_result = cdlod_frame_traverse_budget(&frame, queue, 4 * 6, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              budget_nodes, NODES_CAPACITY, &budget_count);
+  assert(budget_result.status & CDLOD_STATUS_STACK_FULL);
+  assert(budget_count < count);
+
+  /* with culling a node whose children do not fit does not stop the refinement
+   * of nodes with fewer visible children: no selected node that wants to be
+   * subdivided would still fit into the budget
+   */
+  view_projection[0] = 1.0f;
+  view_projection[5] = 1.0f;
+  view_projection[10] = -1000.1f / 999.9f;
+  view_projection[11] = -1.0f;
+  view_projection[12] = -10.0f;
+  view_projection[13] = -5.0f;
+  view_projection[14] = -200.0f / 999.9f;
+
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, 0.0f, 0.0f, -1.0f,
+                   custom_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 9;
+  cdlod_frustum_from_matrix(planes, view_projection);
+  cdlod_frame_set_frustum(&frame, planes, -10.0f, 10.0f);
+
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, nodes, NODES_CAPACITY, &count);
+
+  for (j = 4; j < 20; ++j)
+  {
+    vertex_budget = count * patch_vertices * j / 20;
+    budget_result = cdlod_frame_traverse_budget(&frame, queue, 1024 * 6, vertex_budget, 0, 0, 0, 0, 0, 0, 0,
+                                                budget_nodes, NODES_CAPACITY, &budget_count);
+    refinable += budget_result.status != CDLOD_STATUS_BUDGET;
+
+    for (i = 0; i < budget_count; ++i)
+    {
+      cdlod_quadtree_node node;
+      float h = custom_height_function(budget_nodes[i].x, budget_nodes[i].z);
+      int visible = 0;
+
+      node.x = budget_nodes[i].x;
+      node.z = budget_nodes[i].z;
+      node.size = budget_nodes[i].size;
+      node.lod = budget_nodes[i].lod;
+
+      if (cdlod_frame_leaf(&frame, &node, cdlod_frame_distance_sq(&frame, &node, h, h, 10.0f, 5.0f, 0.0f)))
+      {
+        continue;
+      }
+
+      for (k = 0; k < 4; ++k)
+      {
+        cdlod_quadtree_node child;
+
+        child.x = node.x + ((k == 1 || k == 2) ? 0.25f : -0.25f) * node.size;
+        child.z = node.z + ((k >= 2) ? 0.25f : -0.25f) * node.size;
+        child.size = node.size * 0.5f;
+        child.lod = node.lod - 1;
+
+        visible += !cdlod_frame_culled(&frame, &child, 0);
+      }
+
+      refinable += (budget_count + visible - 1) * patch_vertices <= vertex_budget;
+    }
+  }
+  assert(refinable == 0);
+}
+
+static void cdlod_test_front_to_back(void)
+{
+  static cdlod_node nodes[NODES_CAPACITY];
+  static float vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  static float ordered_vertices[VERTICES_CAPACITY * 32];
+  static int ordered_indices[INDICES_CAPACITY * 32];
+  static int order[NODES_CAPACITY];
+  static float distances[NODES_CAPACITY];
+  int buckets[64];
+  int nodes_count = 0;
+  int vertices_count = 0;
+  int indices_count = 0;
+  int ordered_vertices_count = 0;
+  int ordered_indices_count = 0;
+  int patch_vertices, patch_indices;
+  int out_of_order = 0;
+  int moved = 0;
+  int mismatches = 0;
+  float max_distance = 0.0f;
+  int i;
+
+  float lod_ranges[] = {0.0f, 20.0f, 40.0f, 80.0f, 160.0f};
+  cdlod_frame frame;
+
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, -5.0f, 0.0f, -1.0f,
+                   slope_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 5;
+  frame.morph_mode = CDLOD_MORPH_FACTOR;
+
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 32, &vertices_count,
+                       indices, INDICES_CAPACITY * 32, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+  cdlod_frame_patch_size(&frame, &patch_vertices, &patch_indices);
+  assert(nodes_count > 0 && vertices_count == nodes_count * patch_vertices);
+
+  /* no buckets: selection order, buckets are not touched */
+  buckets[0] = -1;
+  cdlod_frame_front_to_back(&frame, nodes, nodes_count, distances, buckets, 0, order);
+  assert(buckets[0] == -1);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    moved += order[i] != i;
+  }
+  assert(moved == 0);
+
+  cdlod_frame_front_to_back(&frame, nodes, nodes_count, distances, buckets, 64, order);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    float distance = cdlod_frame_node_distance(&frame, &nodes[i]);
+    max_distance = distance > max_distance ? distance : max_distance;
+    mismatches += distances[i] != distance;
+  }
+  assert(mismatches == 0);
+
+  /* ordered by distance up to the bucket width */
+  assert(cdlod_frame_node_distance(&frame, &nodes[order[0]]) < max_distance / 64.0f);
+
+  for (i = 1; i < nodes_count; ++i)
+  {
+    out_of_order += cdlod_frame_node_distance(&frame, &nodes[order[i]]) <
+                    cdlod_frame_node_distance(&frame, &nodes[order[i - 1]]) - max_distance / 64.0f;
+    moved += order[i] != i;
+  }
+  assert(out_of_order == 0);
+  assert(moved > 0);
+
+  /* patches follow the order, indices rebased to their new position */
+  assert(cdlod_frame_order_patches(&frame, nodes, order, nodes_count,
+                                   vertices, indices,
+                                   ordered_vertices, &ordered_vertices_count,
+                                   ordered_indices, &ordered_indices_count));
+  assert(ordered_vertices_count == vertices_count && ordered_indices_count == indices_count);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    int source = order[i];
+    int stride = cdlod_frame_vertex_stride(&frame);
+
+    mismatches += ordered_vertices[i * patch_vertices + 5] != vertices[source * patch_vertices + 5];
+    mismatches += ordered_indices[i * patch_indices] - i * patch_vertices / stride !=
+                  indices[source * patch_indices] - source * patch_vertices / stride;
+  }
+  assert(mismatches == 0);
+
+  /* stitched patches are ordered through their node descriptors */
+  frame.seam_mode = CDLOD_SEAM_STITCH;
+  assert(!cdlod_frame_order_patches(&frame, nodes, order, nodes_count,
+                                    vertices, indices,
+                                    ordered_vertices, &ordered_vertices_count,
+                                    ordered_indices, &ordered_indices_count));
+}
+
+static void cdlod_test_lod_output(void)
+{
+  static cdlod_node nodes[NODES_CAPACITY];
+  static float vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  static float levels[4096 * 6];
+  int nodes_count = 0;
+  int vertices_count = 0;
+  int indices_count = 0;
+  int grouped_nodes_count = 0;
+  int grouped_vertices_count = 0;
+  int grouped_indices_count = 0;
+  int wrong_lod = 0;
+  int outside = 0;
+  int plain_height_calls;
+  int lod, i;
+
+  float lod_ranges[] = {0.0f, 20.0f, 40.0f, 80.0f, 160.0f};
+  cdlod_lod_range ranges[5];
+  cdlod_lod_range counted[5];
+  cdlod_frame frame;
+  cdlod_result plain_result;
+  cdlod_result grouped_result;
+
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, -5.0f, 0.0f, -1.0f,
+                   slope_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 5;
+
+  plain_result = cdlod_frame_traverse(&frame,
+                                      vertices, VERTICES_CAPACITY * 32, &vertices_count,
+                                      indices, INDICES_CAPACITY * 32, &indices_count,
+                                      nodes, NODES_CAPACITY, &nodes_count);
+
+  /* count only pass fills the sizes per lod */
+  frame.lod_output = counted;
+  cdlod_frame_traverse(&frame, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  frame.lod_output = ranges;
+  grouped_result = cdlod_frame_traverse(&frame,
+                                        vertices, VERTICES_CAPACITY * 32, &grouped_vertices_count,
+                                        indices, INDICES_CAPACITY * 32, &grouped_indices_count,
+                                        nodes, NODES_CAPACITY, &grouped_nodes_count);
+
+  assert(grouped_result.status == CDLOD_STATUS_OK);
+  assert(grouped_result.nodes_required == plain_result.nodes_required);
+  assert(grouped_nodes_count == nodes_count && grouped_vertices_count == vertices_count && grouped_indices_count == indices_count);
+  assert(ranges[0].nodes_offset == 0 && ranges[0].nodes_count > 0);
+
+  /* every range holds the patches of its lod only, lod 0 first */
+  for (lod = 0; lod < 5; ++lod)
+  {
+    int first_vertex = ranges[lod].vertices_offset / 3;
+    int end_vertex = (ranges[lod].vertices_offset + ranges[lod].vertices_count) / 3;
+
+    wrong_lod += counted[lod].nodes_count != ranges[lod].nodes_count;
+    wrong_lod += counted[lod].vertices_count != ranges[lod].vertices_count;
+    wrong_lod += lod > 0 && ranges[lod].nodes_offset != ranges[lod - 1].nodes_offset + ranges[lod - 1].nodes_count;
+
+    for (i = 0; i < ranges[lod].nodes_count; ++i)
+    {
+      wrong_lod += nodes[ranges[lod].nodes_offset + i].lod != lod;
+    }
+
+    for (i = 0; i < ranges[lod].indices_count; ++i)
+    {
+      int index = indices[ranges[lod].indices_offset + i];
+      outside += index < first_vertex || index >= end_vertex;
+    }
+  }
+  assert(wrong_lod == 0);
+  assert(outside == 0);
+
+  /* breadth first traversal is grouped coarse lods first */
+  cdlod_frame_traverse_levels(&frame, levels, 4096 * 6, 0, 0, 0, 0, 0, 0,
+                              nodes, NODES_CAPACITY, &grouped_nodes_count);
+  assert(ranges[4].nodes_offset == 0 && ranges[0].nodes_offset + ranges[0].nodes_count == grouped_nodes_count);
+
+  for (lod = 0; lod < 5; ++lod)
+  {
+    wrong_lod += counted[lod].nodes_count != ranges[lod].nodes_count;
+
+    for (i = 0; i < ranges[lod].nodes_count; ++i)
+    {
+      wrong_lod += nodes[ranges[lod].nodes_offset + i].lod != lod;
+    }
+  }
+  assert(wrong_lod == 0);
+
+  /* grouped geometry is placed by the node descriptors */
+  frame.seam_mode = CDLOD_SEAM_STITCH;
+  grouped_result = cdlod_frame_traverse(&frame,
+                                        vertices, VERTICES_CAPACITY * 32, &grouped_vertices_count,
+                                        indices, INDICES_CAPACITY * 32, &grouped_indices_count,
+                                        0, 0, 0);
+  assert(grouped_result.status == CDLOD_STATUS_INVALID);
+
+  /* stitched patches use fewer indices, the ranges follow each other without gaps */
+  grouped_result = cdlod_frame_traverse(&frame,
+                                        vertices, VERTICES_CAPACITY * 32, &grouped_vertices_count,
+                                        indices, INDICES_CAPACITY * 32, &grouped_indices_count,
+                                        nodes, NODES_CAPACITY, &grouped_nodes_count);
+  assert(grouped_result.status == CDLOD_STATUS_OK);
+
+  for (lod = 0; lod < 5; ++lod)
+  {
+    int end_vertex = (ranges[lod].vertices_offset + ranges[lod].vertices_count) / 3;
+    int first_vertex = ranges[lod].vertices_offset / 3;
+
+    if (lod > 0)
+    {
+      outside += ranges[lod].indices_offset != ranges[lod - 1].indices_offset + ranges[lod - 1].indices_count;
+      outside += ranges[lod].vertices_offset != ranges[lod - 1].vertices_offset + ranges[lod - 1].vertices_count;
+    }
+
+    for (i = 0; i < ranges[lod].nodes_count; ++i)
+    {
+      wrong_lod += nodes[ranges[lod].nodes_offset + i].lod != lod;
+    }
+
+    for (i = 0; i < ranges[lod].indices_count; ++i)
+    {
+      int index = indices[ranges[lod].indices_offset + i];
+      outside += index < first_vertex || index >= end_vertex;
+    }
+  }
+  assert(wrong_lod == 0);
+  assert(outside == 0);
+  assert(ranges[4].indices_offset + ranges[4].indices_count == grouped_indices_count);
+  assert(ranges[4].vertices_offset + ranges[4].vertices_count == grouped_vertices_count);
+
+  /* grouping selects once: as many height samples as the plain traversal */
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, -5.0f, 0.0f, -1.0f,
+                   counting_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 5;
+
+  height_calls = 0;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 32, &vertices_count,
+                       indices, INDICES_CAPACITY * 32, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+  plain_height_calls = height_calls;
+
+  frame.lod_output = ranges;
+  height_calls = 0;
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 32, &grouped_vertices_count,
+                       indices, INDICES_CAPACITY * 32, &grouped_indices_count,
+                       nodes, NODES_CAPACITY, &grouped_nodes_count);
+  assert(height_calls == plain_height_calls);
+  assert(grouped_vertices_count == vertices_count);
+}
+
+/* average cache miss ratio: post-transform cache misses (FIFO of cache_size
+ * entries) per triangle of a triangle list or of strips with restart indices
+ */
+static float cdlod_test_acmr(const int *indices, int count, int strips, int restart_index, int cache_size)
+{
+  int cache[64];
+  int cached = 0;
+  int head = 0;
+  int misses = 0;
+  int triangles = 0;
+  int strip_length = 0;
+  int i, j;
+
+  for (i = 0; i < count; ++i)
+  {
+    int hit = 0;
+
+    if (strips && indices[i] == restart_index)
+    {
+      strip_length = 0;
+      continue;
+    }
+
+    triangles += strips ? (++strip_length >= 3) : (i % 3 == 2);
+
+    for (j = 0; j < cached; ++j)
+    {
+      hit |= cache[j] == indices[i];
+    }
+
+    if (!hit)
+    {
+      misses++;
+      cache[head] = indices[i];
+      head = (head + 1) % cache_size;
+      cached += cached < cache_size;
+    }
+  }
+
+  return (float)misses / (float)triangles;
+}
+
+static void cdlod_test_print_ratio(float value)
+{
+  int permille = (int)(value * 1000.0f + 0.5f);
+
+  test_print_int(permille / 1000);
+  test_print_string(".");
+  test_print_int(permille % 1000 / 100);
+  test_print_int(permille % 100 / 10);
+  test_print_int(permille % 10);
+}
+
+static void cdlod_test_index_order(void)
+{
+  static float vertices[VERTICES_CAPACITY];
+  static int indices[INDICES_CAPACITY];
+  static int row_major[INDICES_CAPACITY];
+  static int strip[INDICES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int strip_count = 0;
+  int row_major_count = 0;
+  int grid_indices = 32 * 32 * 6;
+  int flipped = 0;
+  int degenerate = 0;
+  int triangles = 0;
+  int strip_length = 0;
+  int x, z, i;
+  float bands_acmr, row_major_acmr, strip_acmr;
+
+  cdlod_height_source height;
+  cdlod_node node;
+
+  height.function = slope_height_function;
+  height.batch = 0;
+  height.heightmap = 0;
+  height.world = 0;
+
+  node.x = 32.0f;
+  node.z = 32.0f;
+  node.size = 64.0f;
+  node.lod = 0;
+  node.morph_start = CDLOD_MORPH_DISABLED;
+  node.morph_end = CDLOD_MORPH_DISABLED * 2.0f;
+  node.seams = 0;
+
+  assert(cdlod_generate_grid_patch(vertices, VERTICES_CAPACITY, &vertices_count,
+                                   indices, INDICES_CAPACITY, &indices_count,
+                                   &node, &height, 1.0f, 33, CDLOD_MORPH_NONE,
+                                   0.0f, 0.0f, 0.0f));
+  assert(indices_count == cdlod_grid_patch_index_count(33));
+
+  /* previous row by row order of the grid */
+  for (z = 0; z < 32; ++z)
+  {
+    for (x = 0; x < 32; ++x)
+    {
+      int i00 = z * 33 + x;
+
+      row_major[row_major_count++] = i00;
+      row_major[row_major_count++] = i00 + 34;
+      row_major[row_major_count++] = i00 + 1;
+      row_major[row_major_count++] = i00;
+      row_major[row_major_count++] = i00 + 33;
+      row_major[row_major_count++] = i00 + 34;
+    }
+  }
+
+  for (i = 0; i < grid_indices; i += 3)
+  {
+    float *a = &vertices[indices[i] * 3];
+    float *b = &vertices[indices[i + 1] * 3];
+    float *c = &vertices[indices[i + 2] * 3];
+
+    flipped += (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]) <= 0.0f;
+  }
+  assert(flipped == 0);
+
+  row_major_acmr = cdlod_test_acmr(row_major, grid_indices, 0, -1, CDLOD_VERTEX_CACHE_SIZE);
+  bands_acmr = cdlod_test_acmr(indices, grid_indices, 0, -1, CDLOD_VERTEX_CACHE_SIZE);
+  assert(bands_acmr < 0.7f && bands_acmr < row_major_acmr * 0.7f);
+
+  /* strips with primitive restart cover the same patch with the same winding */
+  assert(!cdlod_generate_grid_patch_strip(strip, 16, &strip_count, 0, 33, -1));
+  assert(cdlod_generate_grid_patch_strip(strip, INDICES_CAPACITY, &strip_count, 0, 33, -1));
+  assert(strip_count == cdlod_grid_patch_strip_index_count(33));
+  assert(strip_count < indices_count * 2 / 3);
+
+  for (i = 0; i < strip_count; ++i)
+  {
+    float *a, *b, *c;
+    float area;
+
+    if (strip[i] == -1)
+    {
+      strip_length = 0;
+      continue;
+    }
+
+    if (++strip_length < 3)
+    {
+      continue;
+    }
+
+    /* odd triangles of a strip swap their first two vertices */
+    a = &vertices[strip[(strip_length & 1) ? i - 2 : i - 1] * 3];
+    b = &vertices[strip[(strip_length & 1) ? i - 1 : i - 2] * 3];
+    c = &vertices[strip[i] * 3];
+    triangles++;
+
+    /* same facing as the triangle list (skirt triangles are vertical, area 0) */
+    area = (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]);
+    degenerate += strip[i] == strip[i - 1] || strip[i] == strip[i - 2];
+    flipped += area < 0.0f;
+  }
+  assert(triangles == indices_count / 3);
+  assert(degenerate == 0);
+  assert(flipped == 0);
+
+  strip_acmr = cdlod_test_acmr(strip, strip_count, 1, -1, CDLOD_VERTEX_CACHE_SIZE);
+  assert(strip_acmr < row_major_acmr);
+
+  test_print_string("  acmr (cache ");
+  test_print_int(CDLOD_VERTEX_CACHE_SIZE);
+  test_print_string("): ");
+  cdlod_test_print_ratio(row_major_acmr);
+  test_print_string(" row major, ");
+  cdlod_test_print_ratio(bands_acmr);
+  test_print_string(" bands, ");
+  cdlod_test_print_ratio(strip_acmr);
+  test_print_string(" strips\n");
+}
+
+#define WORLD_OFFSET (64.0 * 8192.0) /* 524 km */
+
+static float world_slope_height_function(double x, double z)
+{
+  return slope_height_function((float)(x - WORLD_OFFSET), (float)(z - WORLD_OFFSET));
+}
+
+static void cdlod_test_large_world(void)
+{
+  static float vertices[VERTICES_CAPACITY * 32];
+  static float world_vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  static cdlod_node nodes[NODES_CAPACITY];
+  static cdlod_node world_nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int world_vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int world_nodes_count = 0;
+  int origin_x = 0;
+  int origin_z = 0;
+  int mismatches = 0;
+  int far_vertices = 0;
+  double world_x, world_z;
+  int i;
+
+  float lod_ranges[] = {0.0f, 20.0f, 40.0f, 80.0f, 160.0f};
+  cdlod_frame frame;
+  cdlod_frame world_frame;
+
+  assert(cdlod_world_cell(-0.5, 64.0f) == -1 && cdlod_world_cell(WORLD_OFFSET + 63.9, 64.0f) == 8192);
+
+  /* the origin follows the camera once it is more than 4 root patches away */
+  assert(cdlod_world_rebase(&origin_x, &origin_z, WORLD_OFFSET + 10.0, WORLD_OFFSET - 5.0, 64.0f, 4));
+  assert(origin_x == 8192 && origin_z == 8191);
+  assert(!cdlod_world_rebase(&origin_x, &origin_z, WORLD_OFFSET + 200.0, WORLD_OFFSET - 5.0, 64.0f, 4));
+  assert(origin_x == 8192);
+
+  /* reference selection next to the world origin */
+  cdlod_frame_init(&frame,
+                   10.0f, 5.0f, -5.0f, 0.0f, -1.0f,
+                   slope_height_function, 64.0f,
+                   5, lod_ranges, 2);
+  frame.patch_resolution = 9;
+
+  cdlod_frame_traverse(&frame,
+                       vertices, VERTICES_CAPACITY * 32, &vertices_count,
+                       indices, INDICES_CAPACITY * 32, &indices_count,
+                       nodes, NODES_CAPACITY, &nodes_count);
+
+  /* the same terrain 524 km away, relative to the origin */
+  cdlod_frame_init_world(&world_frame,
+                         WORLD_OFFSET + 10.0, 5.0, WORLD_OFFSET - 5.0, 0.0f, -1.0f,
+                         origin_x, origin_z,
+                         world_slope_height_function, 64.0f,
+                         5, lod_ranges, 2);
+  world_frame.patch_resolution = 9;
+
+  assert_equalsf(world_frame.camera_x, 10.0f, 0.0001f);
+  assert_equalsf(world_frame.camera_z, 59.0f, 0.0001f);
+
+  cdlod_frame_traverse(&world_frame,
+                       world_vertices, VERTICES_CAPACITY * 32, &world_vertices_count,
+                       indices, INDICES_CAPACITY * 32, &indices_count,
+                       world_nodes, NODES_CAPACITY, &world_nodes_count);
+
+  assert(world_nodes_count == nodes_count && world_vertices_count == vertices_count);
+
+  for (i = 0; i < world_nodes_count && i < nodes_count; ++i)
+  {
+    cdlod_frame_world_position(&world_frame, world_nodes[i].x, world_nodes[i].z, &world_x, &world_z);
+    mismatches += world_x - WORLD_OFFSET != (double)nodes[i].x || world_z - WORLD_OFFSET != (double)nodes[i].z;
+  }
+
+  /* bit identical vertices (z shifted by the one root patch the origins differ) */
+  for (i = 0; i < world_vertices_count && i < vertices_count; i += 3)
+  {
+    mismatches += world_vertices[i] != vertices[i] ||
+                  world_vertices[i + 1] != vertices[i + 1] ||
+                  world_vertices[i + 2] - 64.0f != vertices[i + 2];
+    far_vertices += world_vertices[i] > 4.0f * 64.0f || world_vertices[i] < -4.0f * 64.0f;
+  }
+  assert(mismatches == 0);
+  assert(far_vertices == 0);
+}
+
 static void cdlod_test_performance(void)
 {
   int i;
@@ -128,15 +3338,149 @@ static void cdlod_test_performance(void)
               grid_radius,                                             /* How big is the grid (1=3x3, 3=5x5 patches, ...) */
               skirt_depth); }, "cdlod");
   }
+}
 
-  /* Print aggregated performance metrics */
-  perf_print_stats();
+static void cdlod_test_select(void)
+{
+  static float vertices[VERTICES_CAPACITY * 8];
+  static int indices[INDICES_CAPACITY * 8];
+  cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int lod_histogram[5] = {0};
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f, 400.0f};
+
+  cdlod_select(
+      nodes, NODES_CAPACITY, &nodes_count,
+      0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+      custom_height_function, 64.0f,
+      5, lod_ranges, 2);
+
+  cdlod(vertices, VERTICES_CAPACITY * 8, &vertices_count,
+        indices, INDICES_CAPACITY * 8, &indices_count,
+        0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+        custom_height_function, 64.0f,
+        5, lod_ranges, 2, 10.0f);
+
+  test_print_string("  selected nodes: ");
+  test_print_int(nodes_count);
+  test_print_string(" (");
+  test_print_int(nodes_count * (int)sizeof(cdlod_node));
+  test_print_string(" bytes vs. ");
+  test_print_int(vertices_count * (int)sizeof(float) + indices_count * (int)sizeof(int));
+  test_print_string(" bytes of geometry)\n");
+
+  /* exactly one descriptor per emitted patch (12 vertices each) */
+  assert(nodes_count > 0 && nodes_count < NODES_CAPACITY);
+  assert(nodes_count * 12 * 3 == vertices_count);
+
+  for (i = 0; i < nodes_count; ++i)
+  {
+    cdlod_node *node = &nodes[i];
+
+    if (node->lod < 0 || node->lod >= 5 || node->size != 64.0f / (float)(1 << (4 - node->lod)))
+    {
+      break;
+    }
+
+    if (node->lod < 4 && (node->morph_start >= node->morph_end || node->morph_end != lod_ranges[node->lod + 1]))
+    {
+      break;
+    }
+
+    lod_histogram[node->lod]++;
+  }
+  assert(i == nodes_count);
+  assert(lod_histogram[0] > 0);
+
+  /* the descriptor buffer is never overrun */
+  cdlod_select(
+      nodes, 8, &nodes_count,
+      0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+      custom_height_function, 64.0f,
+      5, lod_ranges, 2);
+  assert(nodes_count == 8);
+}
+
+static void cdlod_test_performance_select(void)
+{
+  static float vertices[VERTICES_CAPACITY * 32];
+  static int indices[INDICES_CAPACITY * 32];
+  static cdlod_node nodes[NODES_CAPACITY];
+  int vertices_count = 0;
+  int indices_count = 0;
+  int nodes_count = 0;
+  int i;
+
+  float lod_ranges[] = {0.0f, 50.0f, 100.0f, 200.0f, 400.0f};
+  int grid_radius = 9; /* 9 = 19x19 patches */
+
+  /* expanded geometry (large enough buffers to not truncate) vs. node descriptors */
+  for (i = 0; i < 10000; ++i)
+  {
+    PERF_PROFILE_WITH_NAME(
+        { cdlod(
+              vertices, VERTICES_CAPACITY * 32, &vertices_count,
+              indices, INDICES_CAPACITY * 32, &indices_count,
+              0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+              custom_height_function, 64.0f,
+              5, lod_ranges, grid_radius, 10.0f); }, "cdlod (geometry)");
+  }
+
+  for (i = 0; i < 10000; ++i)
+  {
+    PERF_PROFILE_WITH_NAME(
+        { cdlod_select(
+              nodes, NODES_CAPACITY, &nodes_count,
+              0.0f, 10.0f, 0.0f, 0.0f, -1.0f,
+              custom_height_function, 64.0f,
+              5, lod_ranges, grid_radius); }, "cdlod_select (nodes)");
+  }
+
+  assert(nodes_count * 12 * 3 == vertices_count);
 }
 
 int main(void)
 {
   cdlod_test_simple();
+  cdlod_test_grid_patch();
+  cdlod_test_morph();
+  cdlod_test_morph_frame();
+  cdlod_test_frustum_culling();
+  cdlod_test_height_pyramid();
+  cdlod_test_height_pyramid_scroll();
+  cdlod_test_root_grid();
+  cdlod_test_result();
+  cdlod_test_grid_vertex_savings();
+  cdlod_test_height_batch();
+  cdlod_test_heightmap();
+  cdlod_test_jobs();
+  cdlod_test_views();
+  cdlod_test_views_seams();
+  cdlod_test_selection();
+  cdlod_test_patch_cache();
+  cdlod_test_layout();
+  cdlod_test_normals();
+  cdlod_test_seams();
+  cdlod_test_quantized();
+  cdlod_test_patch_kernel();
+  cdlod_test_levels();
+  cdlod_test_screen_error();
+  cdlod_test_screen_error_seams();
+  cdlod_test_budget();
+  cdlod_test_front_to_back();
+  cdlod_test_lod_output();
+  cdlod_test_index_order();
+  cdlod_test_large_world();
+  cdlod_test_select();
   cdlod_test_performance();
+  cdlod_test_performance_select();
+
+  /* Print aggregated performance metrics */
+  perf_print_stats();
 
   return 0;
 }